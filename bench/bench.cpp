@@ -0,0 +1,380 @@
+// Emulator benchmarks. Prints one CSV row per workload and engine:
+//   workload,engine,instructions,cycles,seconds,mips,mcycles_per_s,ns_per_insn
+// Usage: bench [--engine interp|blocks|jit|all] [--ms N] [--opcode-ms N]
+//              [--no-opcodes] [--functional 6502_functional_test.bin]
+// The devices:N rows run mix with N interval timers and N UARTs attached;
+// they should stay level with plain mix as N grows. mix:stops runs mix
+// through run_until() with a breakpoint and watchpoints on pages it never
+// touches, and should stay level with mix too.
+#include "cpu.hpp"
+#include "devices.hpp"
+#include "loader.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum Engine
+{
+    ENGINE_INTERP,
+    ENGINE_BLOCKS,
+    ENGINE_JIT,
+};
+
+static const char* engine_names[] = {"interp", "blocks", "jit"};
+
+// Indexed by Mode
+static const char* mode_names[] = {"imp", "acc", "imm", "abs", "zp",
+                                   "absx", "absy", "zpx", "zpy", "ind",
+                                   "inx", "iny", "rel", "ill"};
+
+struct Program
+{
+    std::string name;
+    std::vector<U8> code; // loaded at 0x0600
+    std::vector<std::pair<U16, U8>> pokes;
+    U16 irq = 0; // IRQ/BRK vector when non-zero
+    int devices = 0; // timers from page 0x80 and UARTs from 0xA0, up to 32
+    bool stops = false; // run through run_until() with unrelated stops set
+};
+
+struct Result
+{
+    U64 instructions;
+    U64 cycles;
+    double seconds;
+};
+
+static const U16 START = 0x0600;
+static const int BUDGET = 1 << 20; // cycles per timed run
+
+static void setup(Memory& mem, CPU& cpu, const Program& p)
+{
+    Loader loader(&mem);
+    loader.load_data(p.code.data(), p.code.size(), IMAGE_RAW, START);
+    for (auto& poke : p.pokes)
+        mem.memory[poke.first] = poke.second;
+    if (p.irq)
+        loader.set_vector(IRQ_VECTOR, p.irq);
+    cpu.reset();
+}
+
+// Counts the instructions in one BUDGET run by single stepping, then times
+// whole runs from a snapshot of the same state until ms have passed
+static Result measure(const Program& p, Engine engine, int ms)
+{
+    Result r = {0, 0, 0};
+    {
+        Memory mem(0x10000);
+        CPU cpu(&mem);
+        setup(mem, cpu, p);
+        while (cpu.cycles() < BUDGET)
+        {
+            cpu.step();
+            r.instructions++;
+        }
+    }
+
+    Memory mem(0x10000);
+    CPU cpu(&mem);
+    setup(mem, cpu, p);
+    // Free running timers without IRQ and idle UARTs: the program runs the
+    // same, the timers still expire about every 60000 cycles
+    std::vector<std::unique_ptr<Peripheral>> devices;
+    for (int i = 0; i < p.devices; i++)
+    {
+        U16 timer = (0x80 + i) << 8;
+        U16 period = 60000 + 97 * i;
+        devices.emplace_back(new IntervalTimer());
+        devices.back()->attach(cpu, timer >> 8);
+        mem.write(timer, period & 0xFF);
+        mem.write(timer + 1, period >> 8);
+        mem.write(timer + 2, IntervalTimer::RUNNING);
+        devices.emplace_back(new Uart(stdout));
+        devices.back()->attach(cpu, 0xA0 + i);
+    }
+    if (p.stops)
+    {
+        cpu.set_breakpoint(0x8000, true);
+        cpu.set_watchpoint(0x9000, WATCH_READ | WATCH_WRITE);
+    }
+    cpu.enable_block_cache(engine != ENGINE_INTERP);
+    cpu.enable_jit(engine == ENGINE_JIT);
+    cpu.snapshot();
+    // Warm up caches and get hot blocks translated
+    cpu.execute(BUDGET);
+    cpu.restore();
+
+    U64 runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        r.cycles += p.stops ? cpu.run_until(BUDGET).cycles : cpu.execute(BUDGET);
+        cpu.restore();
+        runs++;
+        elapsed = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    } while (elapsed * 1000 < ms);
+    r.instructions *= runs;
+    r.seconds = elapsed;
+    return r;
+}
+
+static void report(const std::string& name, Engine engine, const Result& r)
+{
+    printf("%s,%s,%llu,%llu,%.6f,%.3f,%.3f,%.3f\n", name.c_str(),
+           engine_names[engine], (unsigned long long)r.instructions,
+           (unsigned long long)r.cycles, r.seconds,
+           r.instructions / r.seconds / 1e6, r.cycles / r.seconds / 1e6,
+           r.seconds * 1e9 / r.instructions);
+    fflush(stdout);
+}
+
+static void jmp(std::vector<U8>& code, U16 target)
+{
+    code.push_back(0x4C);
+    code.push_back(target & 0xFF);
+    code.push_back(target >> 8);
+}
+
+// The opcode unrolled 32 times and a JMP back. Operands point at zero page
+// 0x10 or page 3, with the pointers there aimed at page 3 as well; branches
+// skip 0 bytes so both ways fall through.
+static bool opcode_program(U8 opcode, Program& p)
+{
+    const OpcodeInfo& info = opcode_info[opcode];
+    using enum Mnemonic;
+    switch (info.mnemonic)
+    {
+    case ILLEGAL:
+    case RTS:
+    case RTI:
+        return false;
+    default:
+        break;
+    }
+    char name[32];
+    snprintf(name, sizeof name, "op:%02X:%s_%s", opcode, info.name,
+             mode_names[(int)info.mode]);
+    p.name = name;
+    for (U16 a = 0x10; a < 0x14; a++)
+        p.pokes.push_back({a, 0x03});
+    p.code.clear();
+
+    if (info.mnemonic == JMP)
+    {
+        // Loops on itself; the indirect pointer at 0x0300 holds 0x0600. The
+        // current JMP (ind) lands on 0x0900 instead, which jumps back.
+        p.code = {opcode, 0x00, info.mode == Mode::absolute ? (U8)0x06 : (U8)0x03};
+        p.pokes.push_back({0x0300, 0x00});
+        p.pokes.push_back({0x0301, 0x06});
+        p.pokes.push_back({0x0900, 0x4C});
+        p.pokes.push_back({0x0901, 0x00});
+        p.pokes.push_back({0x0902, 0x06});
+        return true;
+    }
+    if (info.mnemonic == JSR)
+    {
+        p.name = "op:20:JSR+RTS";
+        for (int i = 0; i < 16; i++)
+            p.code.insert(p.code.end(), {0x20, 0x00, 0x07});
+        jmp(p.code, START);
+        p.pokes.push_back({0x0700, 0x60});
+        return true;
+    }
+    if (info.mnemonic == BRK)
+    {
+        // BRK skips a padding byte; RTI comes back after it
+        p.name = "op:00:BRK+RTI";
+        for (int i = 0; i < 16; i++)
+            p.code.insert(p.code.end(), {0x00, 0xEA});
+        jmp(p.code, START);
+        p.pokes.push_back({0x0700, 0x40});
+        p.irq = 0x0700;
+        return true;
+    }
+
+    for (int i = 0; i < 32; i++)
+    {
+        p.code.push_back(opcode);
+        if (info.length >= 2)
+            p.code.push_back(info.mode == Mode::relative ? 0x00 : 0x10);
+        if (info.length == 3)
+            p.code.push_back(0x03);
+    }
+    jmp(p.code, START);
+    return true;
+}
+
+static std::vector<Program> workloads()
+{
+    std::vector<Program> list;
+
+    // Copies eight pages from 0x2000 to 0x4000 through (zp),Y pointers
+    Program copy;
+    copy.name = "memcpy";
+    copy.code = {
+        0xA9, 0x00, 0x85, 0x20, 0x85, 0x22, // pointers' low bytes
+        0xA9, 0x20, 0x85, 0x21,             // source page
+        0xA9, 0x40, 0x85, 0x23,             // destination page
+        0xA2, 0x08,                         // pages to copy
+        0xA0, 0x00,                         //
+        0xB1, 0x20, 0x91, 0x22,             // loop: LDA (src),Y; STA (dst),Y
+        0xC8, 0xD0, 0xF9,                   // INY; BNE loop
+        0xE6, 0x21, 0xE6, 0x23,             // next pages
+        0xCA, 0xD0, 0xF2,                   // DEX; BNE loop
+    };
+    jmp(copy.code, START);
+    list.push_back(copy);
+
+    // Decimal adds and subtracts on a two byte counter
+    Program bcd;
+    bcd.name = "bcd";
+    bcd.code = {
+        0xF8, 0xA2, 0x00,       // SED; LDX #0
+        0x18, 0xA5, 0x10,       // loop: CLC; LDA $10
+        0x69, 0x19, 0x85, 0x10, // ADC #$19; STA $10
+        0xA5, 0x11, 0x69, 0x00, // LDA $11; ADC #0
+        0x85, 0x11, 0x38,       // STA $11; SEC
+        0xE9, 0x01, 0xE5, 0x10, // SBC #1; SBC $10
+        0xCA, 0xD0, 0xEB,       // DEX; BNE loop
+    };
+    jmp(bcd.code, START);
+    list.push_back(bcd);
+
+    // The same in binary mode, which bcd should keep up with
+    Program binary = bcd;
+    binary.name = "binary";
+    binary.code[0] = 0xD8; // CLD
+    list.push_back(binary);
+
+    // Mixed loads, stores, arithmetic and branches
+    Program mix;
+    mix.name = "mix";
+    mix.code = {
+        0xA2, 0x00, 0xE8, 0xB5, 0x10, 0x9D, 0x00, 0x20, 0x69, 0x01,
+        0xC8, 0x88, 0xAA, 0xD0, 0xF4,
+    };
+    jmp(mix.code, START);
+    list.push_back(mix);
+
+    Program stops = mix;
+    stops.name = "mix:stops";
+    stops.stops = true;
+    list.push_back(stops);
+
+    for (int devices : {1, 4, 16, 32})
+    {
+        Program p = mix;
+        p.name = "devices:" + std::to_string(devices);
+        p.devices = devices;
+        list.push_back(p);
+    }
+    return list;
+}
+
+// Klaus Dormann's functional test: a 64K image entered at 0x0400 that ends
+// in a branch or JMP to itself, at 0x3469 when everything passed. The trap
+// is found by single stepping, then the same number of cycles is timed.
+static void functional(const char* path, Engine engine)
+{
+    Memory mem(0x10000);
+    CPU cpu(&mem);
+    Loader loader(&mem);
+    LoadError error = loader.load_file(path, IMAGE_RAW, 0x0000);
+    if (error)
+    {
+        fprintf(stderr, "functional: %s: %s\n", path,
+                Loader::error_string(error));
+        return;
+    }
+    Registers regs = cpu.get_registers();
+    regs.PC = 0x0400;
+    cpu.set_registers(regs);
+    cpu.snapshot();
+
+    Result r = {0, 0, 0};
+    for (U16 pc = 0; r.cycles < 0x7FFFFFFF;)
+    {
+        pc = cpu.get_registers().PC;
+        cpu.step();
+        r.instructions++;
+        r.cycles = cpu.cycles();
+        if (cpu.get_registers().PC == pc)
+            break;
+    }
+    U16 trap = cpu.get_registers().PC;
+
+    cpu.restore();
+    cpu.enable_block_cache(engine != ENGINE_INTERP);
+    cpu.enable_jit(engine == ENGINE_JIT);
+    auto start = std::chrono::steady_clock::now();
+    r.cycles = cpu.execute(r.cycles);
+    r.seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    char name[32];
+    snprintf(name, sizeof name, "functional@%04X", trap);
+    report(name, engine, r);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<Engine> engines = {ENGINE_INTERP, ENGINE_BLOCKS, ENGINE_JIT};
+    int ms = 200, opcode_ms = 10;
+    bool opcodes = true;
+    const char* functional_path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--engine" && has_value)
+        {
+            std::string name = argv[++i];
+            engines.clear();
+            for (int e = 0; e < 3; e++)
+                if (name == "all" || name == engine_names[e])
+                    engines.push_back((Engine)e);
+        }
+        else if (arg == "--ms" && has_value)
+            ms = atoi(argv[++i]);
+        else if (arg == "--opcode-ms" && has_value)
+            opcode_ms = atoi(argv[++i]);
+        else if (arg == "--no-opcodes")
+            opcodes = false;
+        else if (arg == "--functional" && has_value)
+            functional_path = argv[++i];
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [--engine interp|blocks|jit|all] [--ms N] "
+                    "[--opcode-ms N] [--no-opcodes] [--functional FILE]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    printf("workload,engine,instructions,cycles,seconds,mips,mcycles_per_s,"
+           "ns_per_insn\n");
+    for (Engine engine : engines)
+    {
+        for (const Program& p : workloads())
+            report(p.name, engine, measure(p, engine, ms));
+        if (functional_path)
+            functional(functional_path, engine);
+        if (!opcodes)
+            continue;
+        for (int opcode = 0; opcode < 256; opcode++)
+        {
+            Program p;
+            if (opcode_program(opcode, p))
+                report(p.name, engine, measure(p, engine, opcode_ms));
+        }
+    }
+    return 0;
+}
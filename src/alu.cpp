@@ -0,0 +1,18 @@
+#include "alu.hpp"
+
+AluTables alu_tables;
+
+// Too big to build as a constexpr table
+static struct AluInit
+{
+    AluInit()
+    {
+        for (int c = 0; c < 2; c++)
+            for (int a = 0; a < 256; a++)
+                for (int m = 0; m < 256; m++)
+                {
+                    alu_tables.add_decimal[c][a][m] = alu_add_decimal(a, m, c);
+                    alu_tables.sub_decimal[c][a][m] = alu_sub_decimal(a, m, c);
+                }
+    }
+} alu_init;
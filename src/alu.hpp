@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+
+#define U8 uint8_t
+#define U16 uint16_t
+
+// ADC, SBC and compare results, packed: the byte for the register in the low
+// 8 bits, then the flags. In decimal mode the NMOS 6502 takes N, V and Z
+// from intermediate or binary sums rather than from A, so they are carried
+// apart from the result.
+enum
+{
+    ALU_C = 1 << 8,
+    ALU_V = 1 << 9,
+    ALU_N = 1 << 10,
+    ALU_Z = 1 << 11, // set when Z is
+};
+
+constexpr U16 alu_pack(U8 result, bool c, bool v, U8 n, U8 z)
+{
+    return result | (c ? ALU_C : 0) | (v ? ALU_V : 0) | ((n & 0x80) << 3) |
+           (z ? 0 : ALU_Z);
+}
+
+// a + m + c
+constexpr U16 alu_add(U8 a, U8 m, U8 c)
+{
+    unsigned total = a + m + c;
+    U8 r = total;
+    return alu_pack(r, total > 0xFF, ~(a ^ m) & (a ^ r) & 0x80, r, r);
+}
+
+// a - m - (1 - c), done like the 6502 does: a + ~m + c
+constexpr U16 alu_sub(U8 a, U8 m, U8 c) { return alu_add(a, ~m, c); }
+
+// Decimal a + m + c. A and C are right for valid BCD; N, V and Z, and A for
+// invalid digits, are what an NMOS 6502 gives.
+constexpr U16 alu_add_decimal(U8 a, U8 m, U8 c)
+{
+    int lo = (a & 0x0F) + (m & 0x0F) + c;
+    if (lo > 0x09)
+        lo = ((lo + 0x06) & 0x0F) + 0x10;
+    int sum = (a & 0xF0) + (m & 0xF0) + lo;
+    // N and V come from the sum before the high digit is adjusted
+    int signed_sum = (int8_t)(a & 0xF0) + (int8_t)(m & 0xF0) + lo;
+    bool v = signed_sum < -128 || signed_sum > 127;
+    U8 n = sum;
+    if (sum >= 0xA0)
+        sum += 0x60;
+    return alu_pack(sum, sum > 0xFF, v, n, a + m + c);
+}
+
+// Decimal a - m - (1 - c). N, V, Z and C are those of the binary subtract.
+constexpr U16 alu_sub_decimal(U8 a, U8 m, U8 c)
+{
+    int lo = (a & 0x0F) - (m & 0x0F) + c - 1;
+    if (lo < 0)
+        lo = ((lo - 0x06) & 0x0F) - 0x10;
+    int diff = (a & 0xF0) - (m & 0xF0) + lo;
+    if (diff < 0)
+        diff -= 0x60;
+    return (alu_sub(a, m, c) & ~0xFF) | (U8)diff;
+}
+
+// Every decimal ADC and SBC result, indexed [carry][a][m], so BCD costs one
+// load. Binary results are cheaper to compute than to look up in 256K
+// tables. Filled in before main() runs.
+struct AluTables
+{
+    U16 add_decimal[2][256][256];
+    U16 sub_decimal[2][256][256];
+};
+
+extern AluTables alu_tables;
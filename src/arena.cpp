@@ -0,0 +1,109 @@
+#include "arena.hpp"
+#include <cstring>
+#include <new>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define ARENA_MMAP
+#include <sys/mman.h>
+#endif
+
+static const size_t HUGEPAGE_SIZE = 2 << 20;
+
+MemoryArena::~MemoryArena()
+{
+    for (U8* slab : slabs)
+    {
+#ifdef ARENA_MMAP
+        munmap(slab, SLAB_SIZE);
+#else
+        operator delete[](slab, std::align_val_t(SPACE_SIZE));
+#endif
+    }
+}
+
+MemoryArena& MemoryArena::shared()
+{
+    static MemoryArena arena;
+    return arena;
+}
+
+// Fresh slabs come zeroed from the system. Explicit hugepages are tried
+// first; otherwise the slab is aligned to 2M and offered to transparent
+// hugepages.
+bool MemoryArena::grow()
+{
+    U8* slab = nullptr;
+#ifdef ARENA_MMAP
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+        slab = (U8*)p;
+#endif
+    if (!slab)
+    {
+        size_t size = SLAB_SIZE + HUGEPAGE_SIZE;
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+        U8* start = (U8*)p;
+        U8* aligned = (U8*)(((uintptr_t)start + HUGEPAGE_SIZE - 1) &
+                            ~(uintptr_t)(HUGEPAGE_SIZE - 1));
+        if (aligned != start)
+            munmap(start, aligned - start);
+        if (aligned + SLAB_SIZE != start + size)
+            munmap(aligned + SLAB_SIZE, start + size - (aligned + SLAB_SIZE));
+        slab = aligned;
+#ifdef MADV_HUGEPAGE
+        madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+    }
+#else
+    slab = (U8*)operator new[](SLAB_SIZE, std::align_val_t(SPACE_SIZE),
+                               std::nothrow);
+    if (!slab)
+        return false;
+    memset(slab, 0, SLAB_SIZE);
+#endif
+    slabs.push_back(slab);
+    // Handed out from the start of the slab
+    for (size_t offset = SLAB_SIZE; offset; offset -= SPACE_SIZE)
+        clean.push_back(slab + offset - SPACE_SIZE);
+    return true;
+}
+
+void MemoryArena::clear_dirty()
+{
+    for (U8* space : dirty)
+        memset(space, 0, SPACE_SIZE);
+    clean.insert(clean.end(), dirty.begin(), dirty.end());
+    dirty.clear();
+}
+
+U8* MemoryArena::acquire()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (clean.empty())
+    {
+        if (!dirty.empty())
+            clear_dirty();
+        else if (!grow())
+            return nullptr;
+    }
+    U8* space = clean.back();
+    clean.pop_back();
+    return space;
+}
+
+void MemoryArena::release(U8* space)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    dirty.push_back(space);
+}
+
+void MemoryArena::clear_released()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    clear_dirty();
+}
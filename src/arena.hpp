@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define U8 uint8_t
+
+// Hands out zeroed 64K address spaces, aligned to 64K, carved from large
+// slabs backed by hugepages where the system allows. Released spaces are
+// kept and cleared in one batch when they are needed again. Safe to share
+// between threads; the slabs live until the arena is destroyed, so it must
+// outlive every Memory using it.
+class MemoryArena
+{
+public:
+    static const size_t SPACE_SIZE = 0x10000;
+    static const size_t SLAB_SIZE = 32 << 20; // a multiple of 2M hugepages
+
+    ~MemoryArena();
+
+    U8* acquire(); // null when out of memory
+    void release(U8* space);
+    // Zeroes every released space now rather than on a later acquire()
+    void clear_released();
+
+    // One arena for the whole process
+    static MemoryArena& shared();
+
+private:
+    std::mutex lock;
+    std::vector<U8*> slabs;
+    std::vector<U8*> clean; // zeroed and free
+    std::vector<U8*> dirty; // free, holding old contents
+
+    bool grow();
+    void clear_dirty();
+};
@@ -0,0 +1,143 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+// Each worker's share of the job indices, [begin, end) packed into one word
+// so the owner taking from the front and thieves splitting off the back
+// agree through a single compare-and-swap.
+struct alignas(64) WorkRange
+{
+    std::atomic<U64> range{0};
+
+    static U64 pack(U32 begin, U32 end) { return ((U64)end << 32) | begin; }
+
+    void set(U32 begin, U32 end) { range.store(pack(begin, end)); }
+
+    // Next index from the front, or -1 when empty
+    long take()
+    {
+        U64 r = range.load();
+        for (;;)
+        {
+            U32 begin = (U32)r, end = r >> 32;
+            if (begin >= end)
+                return -1;
+            if (range.compare_exchange_weak(r, pack(begin + 1, end)))
+                return begin;
+        }
+    }
+
+    // Splits off the back half into [begin, end); false when empty
+    bool steal(U32& begin, U32& end)
+    {
+        U64 r = range.load();
+        for (;;)
+        {
+            U32 b = (U32)r, e = r >> 32;
+            if (b >= e)
+                return false;
+            U32 split = e - (e - b + 1) / 2;
+            if (range.compare_exchange_weak(r, pack(b, split)))
+            {
+                begin = split;
+                end = e;
+                return true;
+            }
+        }
+    }
+};
+
+U64 memory_digest(const Memory& mem)
+{
+    U64 hash = 14695981039346656037ull;
+    for (U32 i = 0; i < mem.backing_size; i++)
+    {
+        hash ^= mem.peek(i);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+BatchRunner::BatchRunner(int threads)
+{
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    this->threads = threads;
+}
+
+static void run_job(CPU& cpu, Memory& mem, const BatchJob& job,
+                    BatchResult& result)
+{
+    memset(mem.memory, 0, mem.backing_size);
+    U32 size = std::min(job.image_size, mem.backing_size - job.load_address);
+    if (job.image && size)
+        memcpy(mem.memory + job.load_address, job.image, size);
+    mem.unmap_rom(0, 256);
+    if (job.rom)
+        mem.map_rom(job.rom_page, *job.rom);
+    // The image went in behind the block cache's back
+    cpu.flush_block_cache();
+
+    cpu.reset();
+    Registers r = cpu.get_registers();
+    r.PC = job.entry;
+    cpu.set_registers(r);
+    if (job.stop_pc >= 0)
+        result.cycles = cpu.execute_until(job.cycles, job.stop_pc);
+    else
+        result.cycles = cpu.execute(job.cycles);
+    result.registers = cpu.get_registers();
+    result.stopped = job.stop_pc >= 0 && result.registers.PC == job.stop_pc;
+    result.memory_digest = memory_digest(mem);
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob>& jobs)
+{
+    std::vector<BatchResult> results(jobs.size());
+    int workers = std::max(1, std::min<int>(threads, jobs.size()));
+    std::vector<WorkRange> ranges(workers);
+    for (int i = 0; i < workers; i++)
+        ranges[i].set(jobs.size() * i / workers,
+                      jobs.size() * (i + 1) / workers);
+
+    auto worker = [&](int self)
+    {
+        Memory mem(0x10000, &MemoryArena::shared());
+        CPU cpu(&mem);
+        cpu.report_illegal = false;
+        cpu.enable_block_cache(use_block_cache);
+        cpu.enable_jit(use_jit);
+        for (;;)
+        {
+            long index = ranges[self].take();
+            if (index < 0)
+            {
+                // Out of work: move half of someone else's into our range
+                bool stole = false;
+                for (int i = 1; i < workers && !stole; i++)
+                {
+                    U32 begin, end;
+                    if (ranges[(self + i) % workers].steal(begin, end))
+                    {
+                        ranges[self].set(begin, end);
+                        stole = true;
+                    }
+                }
+                if (!stole)
+                    return;
+                continue;
+            }
+            run_job(cpu, mem, jobs[index], results[index]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < workers; i++)
+        pool.emplace_back(worker, i);
+    worker(0);
+    for (std::thread& t : pool)
+        t.join();
+    return results;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "cpu.hpp"
+#include "rom.hpp"
+#include <vector>
+
+// One independent program: image is copied to load_address in an otherwise
+// zeroed 64K memory and run from entry for up to cycles cycles, or until PC
+// reaches stop_pc (negative for no stop address). A rom, if any, is mapped
+// shared from rom_page on, so jobs with the same firmware share its bytes.
+struct BatchJob
+{
+    const U8* image = nullptr;
+    U32 image_size = 0;
+    U16 load_address = 0x0600;
+    U16 entry = 0x0600;
+    int cycles = 0;
+    int stop_pc = -1;
+    const SharedRom* rom = nullptr;
+    U8 rom_page = 0;
+};
+
+struct BatchResult
+{
+    Registers registers;
+    int cycles = 0;       // cycles actually run
+    bool stopped = false; // reached stop_pc
+    U64 memory_digest = 0; // FNV-1a over the whole memory as read
+};
+
+// Runs jobs across a pool of threads. Every worker owns its Memory and CPU
+// and reuses them from job to job; idle workers steal half of the remaining
+// jobs of a busy one.
+class BatchRunner
+{
+public:
+    int threads;
+    bool use_block_cache = false;
+    bool use_jit = false;
+
+    BatchRunner(int threads = 0); // 0: one per hardware thread
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs);
+};
+
+U64 memory_digest(const Memory& mem);
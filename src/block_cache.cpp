@@ -0,0 +1,368 @@
+#include "block_cache.hpp"
+#include "cpu_ops.hpp"
+#include <algorithm>
+#include <cstring>
+
+template <Mnemonic M, Mode AM> void CPU::run_op(CPU& cpu, U16 operand)
+{
+    cpu.op<M, AM>(operand);
+}
+
+void (*const CPU::fused_handlers[256])(CPU&, U16) = {
+#define X(code, mnemonic, mode, cycles) &CPU::run_op<Mnemonic::mnemonic, Mode::mode>,
+    OPCODE_LIST(X)
+#undef X
+};
+
+static bool ends_block(Mnemonic m)
+{
+    switch (m)
+    {
+    case Mnemonic::BCC:
+    case Mnemonic::BCS:
+    case Mnemonic::BEQ:
+    case Mnemonic::BMI:
+    case Mnemonic::BNE:
+    case Mnemonic::BPL:
+    case Mnemonic::BVC:
+    case Mnemonic::BVS:
+    case Mnemonic::JMP:
+    case Mnemonic::JSR:
+    case Mnemonic::RTS:
+    case Mnemonic::RTI:
+    case Mnemonic::BRK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Pages holding cached code are write-trapped (PAGE_CODE), so plain stores
+// cost nothing extra and the first write to such a page drops its blocks.
+BlockCache::BlockCache(Memory* memory)
+{
+    mem = memory;
+    mem->on_code_write = &BlockCache::code_written;
+    mem->code_write_context = this;
+}
+
+BlockCache::~BlockCache()
+{
+    clear();
+    mem->on_code_write = nullptr;
+    mem->code_write_context = nullptr;
+}
+
+void BlockCache::code_written(void* context, U8 page)
+{
+    ((BlockCache*)context)->invalidate_page(page);
+}
+
+Block* BlockCache::find(U16 pc)
+{
+    Block*& slot = lookup[pc % LOOKUP_SIZE];
+    if (slot && slot->start == pc)
+        return slot;
+    auto it = blocks.find(pc);
+    if (it == blocks.end())
+        return nullptr;
+    return slot = &it->second;
+}
+
+Block& BlockCache::insert(Block&& block)
+{
+    U16 start = block.start;
+    for (int page = start >> 8;; page = (page + 1) & 0xFF)
+    {
+        page_blocks[page].push_back(start);
+        mem->set_page_flag(page, PAGE_CODE, true);
+        if (page == block.end >> 8)
+            break;
+    }
+    return blocks[start] = std::move(block);
+}
+
+void BlockCache::erase(U16 start)
+{
+    auto it = blocks.find(start);
+    if (it == blocks.end())
+        return;
+    for (int page = start >> 8;; page = (page + 1) & 0xFF)
+    {
+        std::vector<U16>& list = page_blocks[page];
+        list.erase(std::remove(list.begin(), list.end(), start), list.end());
+        if (list.empty())
+            mem->set_page_flag(page, PAGE_CODE, false);
+        if (page == it->second.end >> 8)
+            break;
+    }
+    Block*& slot = lookup[start % LOOKUP_SIZE];
+    if (slot == &it->second)
+        slot = nullptr;
+    blocks.erase(it);
+    stats.invalidations++;
+}
+
+void BlockCache::invalidate_page(U8 page)
+{
+    std::vector<U16> starts = page_blocks[page];
+    for (U16 start : starts)
+        erase(start);
+    invalidated = true;
+}
+
+void CPU::enable_block_cache(bool enable)
+{
+    if (enable && !block_cache)
+        block_cache = new BlockCache(mem);
+    else if (!enable)
+    {
+        // The JIT runs out of cached blocks
+        enable_jit(false);
+        delete block_cache;
+        block_cache = nullptr;
+    }
+}
+
+void CPU::flush_block_cache()
+{
+    if (block_cache)
+        block_cache->clear();
+}
+
+void BlockCache::clear()
+{
+    blocks.clear();
+    for (Block*& slot : lookup)
+        slot = nullptr;
+    for (int page = 0; page < 256; page++)
+    {
+        page_blocks[page].clear();
+        mem->set_page_flag(page, PAGE_CODE, false);
+    }
+    invalidated = true;
+}
+
+BlockCacheStats CPU::block_cache_stats()
+{
+    return block_cache ? block_cache->stats : BlockCacheStats();
+}
+
+// Whether an instruction can be part of an idle loop: it writes no memory
+// and reads, if at all, from a fixed address
+static bool idle_safe(const OpcodeInfo& info)
+{
+    switch (info.mnemonic)
+    {
+    case Mnemonic::STA:
+    case Mnemonic::STX:
+    case Mnemonic::STY:
+    case Mnemonic::PHA:
+    case Mnemonic::PHP:
+    case Mnemonic::PLA:
+    case Mnemonic::PLP:
+    case Mnemonic::JSR:
+    case Mnemonic::RTS:
+    case Mnemonic::RTI:
+    case Mnemonic::BRK:
+    case Mnemonic::ILLEGAL:
+        return false;
+    case Mnemonic::INC:
+    case Mnemonic::DEC:
+    case Mnemonic::ASL:
+    case Mnemonic::LSR:
+    case Mnemonic::ROL:
+    case Mnemonic::ROR:
+        return info.mode == Mode::accumulator;
+    default:
+        break;
+    }
+    switch (info.mode)
+    {
+    case Mode::implied:
+    case Mode::accumulator:
+    case Mode::immediate:
+    case Mode::zero_page:
+    case Mode::absolute:
+    case Mode::relative:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Only code on plain RAM/ROM pages is cached; fetching from device pages
+// has side effects, so a block stops before any instruction whose bytes lie
+// on one. Operands may still address device pages: those accesses go
+// through the page table at run time like the interpreter's. Returns null
+// when not even the first instruction can be cached.
+Block* CPU::decode_block(U16 start)
+{
+    Block block;
+    block.start = start;
+    U16 pc = start;
+    for (int i = 0; i < BlockCache::MAX_BLOCK_OPS; i++)
+    {
+        if (!mem->read_map[pc >> 8])
+            break;
+        U8 opcode = read_byte(pc);
+        const OpcodeInfo& info = opcode_info[opcode];
+        if (!mem->read_map[(U16)(pc + info.length - 1) >> 8])
+            break;
+        DecodedOp d;
+        d.handler = fused_handlers[opcode];
+        d.opcode = opcode;
+        d.cycles = info.cycles;
+        if (info.length == 3)
+            d.operand = read_word(pc + 1);
+        else if (info.length == 2)
+            d.operand = read_byte(pc + 1);
+        else
+            d.operand = 0;
+        d.next_pc = pc + info.length;
+        block.end = pc + info.length - 1;
+        block.ops.push_back(d);
+        block.lead_cycles += d.cycles;
+        pc = d.next_pc;
+        if (ends_block(info.mnemonic))
+            break;
+    }
+    if (block.ops.empty())
+        return nullptr;
+    block.lead_cycles -= block.ops.back().cycles;
+
+    // A block that only reads and jumps back to its own start
+    const DecodedOp& last = block.ops.back();
+    const OpcodeInfo& info = opcode_info[last.opcode];
+    U16 target = info.mode == Mode::relative ? last.next_pc + (int8_t)last.operand
+                 : info.mnemonic == Mnemonic::JMP && info.mode == Mode::absolute
+                     ? last.operand
+                     : start + 1;
+    block.idle = target == start;
+    for (const DecodedOp& d : block.ops)
+        block.idle = block.idle && idle_safe(opcode_info[d.opcode]);
+    return &block_cache->insert(std::move(block));
+}
+
+// An idle loop is a block from the same state twice in a row, with nothing
+// else run in between. It writes nothing and reads only RAM/ROM, so every
+// further pass does the same until an event, interrupt or device changes
+// something, and none of those can happen before slice_end. Skips the
+// whole passes that fit before then, leaving the interpreter to stop at
+// the same instruction it would have.
+bool CPU::skip_idle_loop(const Block& block)
+{
+    for (const DecodedOp& d : block.ops)
+    {
+        Mode mode = opcode_info[d.opcode].mode;
+        if ((mode == Mode::zero_page && !mem->read_map[0]) ||
+            (mode == Mode::absolute && !mem->read_map[d.operand >> 8] &&
+             opcode_info[d.opcode].mnemonic != Mnemonic::JMP))
+            return false;
+    }
+    U64 pass = block.lead_cycles + block.ops.back().cycles;
+    U64 skipped = (slice_end - cycle_count) / pass * pass;
+    if (!skipped)
+        return false;
+    cycle_count += skipped;
+    block_cache->stats.idle_skips++;
+    block_cache->stats.idle_cycles += skipped;
+    return true;
+}
+
+// Under STOP, whether execute_until()'s PC or a stop opcode is inside the
+// block, which then runs op by op with checks: no native code and no idle
+// skipping. Breakpoints never are, blocks aren't made on their pages.
+bool CPU::block_has_stop(const Block& block)
+{
+    if (until_pc >= 0 && block.holds_later(until_pc))
+        return true;
+    if (opcode_stop_count)
+        for (const DecodedOp& d : block.ops)
+            if (opcode_stops[d.opcode])
+                return true;
+    return false;
+}
+
+template <bool STOP> void CPU::execute_blocks()
+{
+    // The idle loop candidate last entered and the state it was entered with
+    const Block* idle_block = nullptr;
+    U8 idle_state[5];
+
+    while (cycle_count < slice_end && !(STOP && PC == until_pc))
+    {
+        Block* block = block_cache->find(PC);
+        if (block)
+            block_cache->stats.hits++;
+        else
+        {
+            block_cache->stats.misses++;
+            block = decode_block(PC);
+            if (!block)
+            {
+                idle_block = nullptr;
+                U8 opcode;
+                if (!fetch<STOP>(opcode))
+                    return;
+                cycle_count += opcode_info[opcode].cycles;
+                dispatch(opcode);
+                continue;
+            }
+        }
+
+        bool checked = STOP && block_has_stop(*block);
+        if (block->idle && skip_idle && !checked)
+        {
+            U8 state[5] = {A, X, Y, SP, get_status()};
+            if (block == idle_block && !memcmp(state, idle_state, 5) &&
+                skip_idle_loop(*block))
+                idle_block = nullptr;
+            else
+            {
+                idle_block = block;
+                memcpy(idle_state, state, 5);
+            }
+        }
+        else
+            idle_block = nullptr;
+
+        block_cache->invalidated = false;
+        if (jit)
+        {
+            if (!block->native && !block->no_jit &&
+                ++block->runs >= Jit::HOT_THRESHOLD)
+            {
+                block->native = jit_compile(*block);
+                block->no_jit = !block->native;
+            }
+            // Native code runs the whole block, so only take it when the
+            // interpreter would have started every instruction in it
+            if (block->native && cycle_count + block->lead_cycles < slice_end &&
+                !checked)
+            {
+                jit->stats.native_runs++;
+                cycle_count += block->native(this);
+                continue;
+            }
+        }
+        const DecodedOp* d = block->ops.data();
+        const DecodedOp* end = d + block->ops.size();
+        for (; d != end && cycle_count < slice_end; d++)
+        {
+            if (checked && ((d != block->ops.data() && PC == until_pc) ||
+                            stop_opcode(d->opcode)))
+                return;
+            // A store into this block frees it, so take what we need first
+            DecodedOp op = *d;
+            PC = op.next_pc;
+            cycle_count += op.cycles;
+            op.handler(*this, op.operand);
+            if (block_cache->invalidated)
+                break;
+        }
+    }
+}
+
+template void CPU::execute_blocks<false>();
+template void CPU::execute_blocks<true>();
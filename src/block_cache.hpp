@@ -0,0 +1,65 @@
+#pragma once
+#include "cpu.hpp"
+#include "jit.hpp"
+#include <unordered_map>
+#include <vector>
+
+// One predecoded instruction. handler is the fused op<M, AM> for the opcode
+// and operand the bytes fetch_operand() would have read.
+struct DecodedOp
+{
+    void (*handler)(CPU&, U16);
+    U16 operand;
+    U16 next_pc;
+    U8 opcode;
+    U8 cycles;
+};
+
+// Straight-line run of instructions starting at a PC, ending after the first
+// branch, jump, return or BRK.
+struct Block
+{
+    U16 start;
+    U16 end; // address of the last byte in the block
+    std::vector<DecodedOp> ops;
+    int lead_cycles = 0; // cycles of every op but the last
+    U32 runs = 0;
+    JitCode native = nullptr;
+    bool no_jit = false;
+    bool idle = false; // may be an idle loop, see CPU::skip_idle_loop()
+
+    // Whether pc is inside the block past its first byte
+    bool holds_later(U16 pc) const
+    {
+        U16 offset = pc - start;
+        return offset != 0 && offset <= (U16)(end - start);
+    }
+};
+
+class BlockCache
+{
+public:
+    static const int MAX_BLOCK_OPS = 32;
+
+    static const int LOOKUP_SIZE = 1024;
+
+    std::unordered_map<U16, Block> blocks;
+    Block* lookup[LOOKUP_SIZE] = {}; // direct-mapped front for blocks
+    std::vector<U16> page_blocks[256]; // start PCs of blocks touching a page
+    bool invalidated = false; // leave the running block: its code was
+                              // written or the slice was cut short
+    BlockCacheStats stats;
+    Memory* mem;
+
+    BlockCache(Memory* memory);
+    ~BlockCache();
+
+    Block* find(U16 pc);
+    Block& insert(Block&& block);
+    void invalidate_page(U8 page);
+    void clear();
+
+private:
+    void erase(U16 start);
+    static void code_written(void* context, U8 page);
+};
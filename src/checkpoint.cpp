@@ -0,0 +1,364 @@
+#include "checkpoint.hpp"
+#include <cstring>
+#include <filesystem>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CHECKPOINT_MMAP
+#endif
+
+static const char BASE_MAGIC[8] = {'6', '5', '0', '2', 'C', 'K', 'B', '1'};
+static const char DELTA_MAGIC[8] = {'6', '5', '0', '2', 'C', 'K', 'D', '1'};
+static const size_t STATE_SIZE = 4 + 4 + 8 + 4 + 1 + 2 + 5;
+static const size_t DELTA_HEADER = 8 + 8;
+
+static void put(std::vector<U8>& out, U64 value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        out.push_back(value >> (i * 8));
+}
+
+static U64 get(const U8*& p, int bytes)
+{
+    U64 value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (U64)*p++ << (i * 8);
+    return value;
+}
+
+// A whole file, mapped where possible; empty if it can't be read
+struct FileBytes
+{
+    const U8* data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+#ifdef CHECKPOINT_MMAP
+    void* mapping = nullptr;
+#else
+    std::vector<U8> buffer;
+#endif
+
+    FileBytes(const char* path)
+    {
+#ifdef CHECKPOINT_MMAP
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        opened = true;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                data = (const U8*)mapping;
+                size = st.st_size;
+            }
+            else
+                mapping = nullptr;
+        }
+        close(fd);
+#else
+        FILE* file = fopen(path, "rb");
+        if (!file)
+            return;
+        opened = true;
+        U8 chunk[1 << 16];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof chunk, file)) > 0)
+            buffer.insert(buffer.end(), chunk, chunk + n);
+        if (!ferror(file))
+        {
+            data = buffer.data();
+            size = buffer.size();
+        }
+        fclose(file);
+#endif
+    }
+
+    ~FileBytes()
+    {
+#ifdef CHECKPOINT_MMAP
+        if (mapping)
+            munmap(mapping, size);
+#endif
+    }
+};
+
+Checkpointer::Checkpointer(CPU* cpu) : cpu(cpu), mem(cpu->memory()) {}
+
+Checkpointer::~Checkpointer() { finish(); }
+
+void Checkpointer::put_state(std::vector<U8>& out)
+{
+    Registers r = cpu->get_registers();
+    put(out, next_sequence++, 4);
+    put(out, mem->mem_size, 4);
+    put(out, cpu->cycle_count, 8);
+    put(out, cpu->irq_lines, 4);
+    put(out, cpu->nmi_pending, 1);
+    put(out, r.PC, 2);
+    out.push_back(r.A);
+    out.push_back(r.X);
+    out.push_back(r.Y);
+    out.push_back(r.SP);
+    out.push_back(r.P);
+}
+
+bool Checkpointer::get_state(const U8*& p, const U8* end, State& state)
+{
+    if ((size_t)(end - p) < STATE_SIZE)
+        return false;
+    state.sequence = get(p, 4);
+    state.mem_size = get(p, 4);
+    state.cycles = get(p, 8);
+    state.irq_lines = get(p, 4);
+    state.nmi_pending = get(p, 1);
+    state.registers.PC = get(p, 2);
+    state.registers.A = *p++;
+    state.registers.X = *p++;
+    state.registers.Y = *p++;
+    state.registers.SP = *p++;
+    state.registers.P = *p++;
+    return true;
+}
+
+void Checkpointer::set_state(const State& state)
+{
+    cpu->set_registers(state.registers);
+    cpu->cycle_count = state.cycles;
+    cpu->irq_lines = state.irq_lines;
+    cpu->nmi_pending = state.nmi_pending;
+    cpu->scheduler.clear();
+    next_sequence = state.sequence + 1;
+}
+
+bool Checkpointer::start(const char* base_path, const char* delta_path)
+{
+    Job job;
+    job.base_path = base_path;
+    job.delta_path = delta_path;
+    job.base = fopen((job.base_path + ".tmp").c_str(), "wb");
+    if (!job.base)
+        return false;
+
+    next_sequence = 0;
+    base_cycles = cpu->cycle_count;
+    job.bytes.reserve(sizeof BASE_MAGIC + STATE_SIZE + mem->backing_size);
+    job.bytes.insert(job.bytes.end(), BASE_MAGIC, BASE_MAGIC + 8);
+    put_state(job.bytes);
+    job.bytes.insert(job.bytes.end(), mem->memory,
+                     mem->memory + mem->backing_size);
+    mem->track_writes(true);
+    push(std::move(job));
+    return true;
+}
+
+bool Checkpointer::resume(const char* delta_path)
+{
+    finish();
+    if (write_failed)
+        return false;
+    std::error_code error;
+    if (std::filesystem::exists(delta_path, error))
+        std::filesystem::resize_file(delta_path, delta_valid, error);
+    if (error)
+        return false;
+    delta = fopen(delta_path, "ab");
+    if (!delta)
+        return false;
+    if (!delta_valid)
+    {
+        // Missing or stale, so it starts over after the loaded base
+        std::vector<U8> header(DELTA_MAGIC, DELTA_MAGIC + 8);
+        put(header, base_cycles, 8);
+        if (fwrite(header.data(), 1, header.size(), delta) != header.size())
+            return false;
+        delta_valid = DELTA_HEADER;
+    }
+    mem->track_writes(true);
+    stopping = false;
+    write_failed = false;
+    writer = std::thread(&Checkpointer::drain, this);
+    return true;
+}
+
+void Checkpointer::checkpoint()
+{
+    if (!writer.joinable())
+        return;
+    Job job;
+    int pages = 0;
+    for (int word = 0; word < 4; word++)
+        pages += __builtin_popcountll(mem->dirty_bitmap[word]);
+    job.bytes.reserve(STATE_SIZE + 2 + pages * 257);
+    put_state(job.bytes);
+    put(job.bytes, pages, 2);
+    for (int page = 0; page < 256; page++)
+        if (mem->page_dirty(page))
+        {
+            job.bytes.push_back(page);
+            const U8* bytes = mem->memory + (page << 8);
+            job.bytes.insert(job.bytes.end(), bytes, bytes + 256);
+        }
+    mem->clear_dirty();
+    push(std::move(job));
+}
+
+void Checkpointer::push(Job&& job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(std::move(job));
+    }
+    if (!writer.joinable())
+    {
+        stopping = false;
+        write_failed = false;
+        writer = std::thread(&Checkpointer::drain, this);
+    }
+    else
+        wake.notify_one();
+}
+
+void Checkpointer::finish()
+{
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+    if (delta)
+    {
+        fclose(delta);
+        delta = nullptr;
+    }
+}
+
+// The writer thread. Records after a failed one are dropped, as they would
+// not load without it, until the next base.
+void Checkpointer::drain()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    bool broken = false;
+    for (;;)
+    {
+        wake.wait(guard, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        guard.unlock();
+
+        if (job.base)
+            broken = !write_base(job);
+        else if (!broken)
+        {
+            broken = !delta ||
+                     fwrite(job.bytes.data(), 1, job.bytes.size(), delta) !=
+                         job.bytes.size() ||
+                     fflush(delta) != 0;
+            if (!broken)
+                delta_valid += job.bytes.size();
+        }
+
+        guard.lock();
+        if (broken)
+            write_failed = true;
+    }
+}
+
+bool Checkpointer::write_base(Job& job)
+{
+    if (delta)
+    {
+        fclose(delta);
+        delta = nullptr;
+    }
+    bool ok = fwrite(job.bytes.data(), 1, job.bytes.size(), job.base) ==
+              job.bytes.size();
+    ok = fclose(job.base) == 0 && ok;
+    std::string tmp = job.base_path + ".tmp";
+    if (!ok || std::rename(tmp.c_str(), job.base_path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    delta_valid = 0;
+    delta = fopen(job.delta_path.c_str(), "wb");
+    if (!delta)
+        return false;
+    std::vector<U8> header(DELTA_MAGIC, DELTA_MAGIC + 8);
+    const U8* p = job.bytes.data() + sizeof BASE_MAGIC + 8;
+    put(header, get(p, 8), 8); // the base's cycle count
+    if (fwrite(header.data(), 1, header.size(), delta) != header.size() ||
+        fflush(delta) != 0)
+        return false;
+    delta_valid = DELTA_HEADER;
+    return true;
+}
+
+LoadError Checkpointer::load(const char* base_path, const char* delta_path)
+{
+    FileBytes base(base_path);
+    if (!base.opened)
+        return LOAD_OPEN_FAILED;
+    if (!base.data)
+        return LOAD_READ_FAILED;
+    const U8* p = base.data;
+    const U8* end = base.data + base.size;
+    State state;
+    if (base.size < sizeof BASE_MAGIC ||
+        memcmp(p, BASE_MAGIC, sizeof BASE_MAGIC))
+        return LOAD_BAD_FORMAT;
+    p += sizeof BASE_MAGIC;
+    if (!get_state(p, end, state) || state.sequence != 0)
+        return LOAD_BAD_FORMAT;
+    if (state.mem_size != mem->mem_size ||
+        (size_t)(end - p) != mem->backing_size)
+        return LOAD_BAD_FORMAT;
+    mem->load(0, p, mem->backing_size);
+    set_state(state);
+    base_cycles = state.cycles;
+    delta_valid = 0;
+    write_failed = false;
+
+    FileBytes deltas(delta_path);
+    p = deltas.data;
+    end = deltas.data + deltas.size;
+    if (deltas.size < DELTA_HEADER || memcmp(p, DELTA_MAGIC, 8))
+        return LOAD_OK;
+    p += 8;
+    if (get(p, 8) != base_cycles)
+        return LOAD_OK;
+    delta_valid = DELTA_HEADER;
+
+    // Each record is checked whole before any of it is applied
+    for (;;)
+    {
+        const U8* record = p;
+        if (!get_state(p, end, state) || state.sequence != next_sequence ||
+            state.mem_size != mem->mem_size || end - p < 2)
+            break;
+        U32 pages = get(p, 2);
+        if ((size_t)(end - p) < pages * 257)
+            break;
+        bool fits = true;
+        for (U32 i = 0; i < pages; i++)
+            fits = fits && ((U32)p[i * 257] << 8) < mem->backing_size;
+        if (!fits)
+            break;
+        for (U32 i = 0; i < pages; i++, p += 257)
+            mem->load(p[0] << 8, p + 1, 256);
+        set_state(state);
+        delta_valid += p - record;
+    }
+    return LOAD_OK;
+}
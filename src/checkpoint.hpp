@@ -0,0 +1,97 @@
+#pragma once
+#include "cpu.hpp"
+#include "loader.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checkpoint files, little-endian throughout. A base file holds the whole
+// machine; its delta file is a stream of records, each holding the state and
+// the pages written since the checkpoint before it.
+//   base:   "6502CKB1", state, then the backing store (mem_size rounded up
+//           to whole pages)
+//   delta:  "6502CKD1", the base's cycle count (U64), then records
+//   record: state, page count (U16), per page its number (U8) and 256 bytes
+//   state:  sequence (U32), mem_size (U32), cycles (U64), irq lines (U32),
+//           NMI pending (U8), PC (U16), A, X, Y, SP, P
+// The base is sequence 0 and every record the next one. A delta file whose
+// cycle count doesn't match the base is stale and ignored, and a record cut
+// short by a crash ends the stream. Events, devices and caches are not
+// saved: a loaded machine has no pending events and devices start over.
+
+// Writes checkpoints of one machine. checkpoint() only copies what changed
+// and queues it; a writer thread does the file I/O, so the emulation thread
+// is held up for a memcpy of the dirty pages.
+class Checkpointer
+{
+public:
+    Checkpointer(CPU* cpu);
+    ~Checkpointer(); // finish()
+
+    // Writes a full base (to a temporary file, renamed when complete) and
+    // starts a new delta file after it. Turns on the Memory's dirty page
+    // tracking. False if the files can't be created; the writer finds that
+    // out later, so failed() reports it too.
+    bool start(const char* base_path, const char* delta_path);
+    // Goes on appending to delta_path after load() of it, or after finish()
+    // of the stream start() began there. False if a write failed since, as
+    // records after the gap would not load.
+    bool resume(const char* delta_path);
+    // Queues the state and the pages written since the last checkpoint
+    void checkpoint();
+    // Waits until everything queued is on disk and closes the delta file
+    void finish();
+    bool failed() { return write_failed; }
+
+    // Loads the base, then every complete record of the delta file, which
+    // may be missing. Leaves the sequence number for resume().
+    LoadError load(const char* base_path, const char* delta_path);
+    U32 sequence() { return next_sequence - 1; }
+
+private:
+    struct State
+    {
+        U32 sequence;
+        U32 mem_size;
+        U64 cycles;
+        U32 irq_lines;
+        U8 nmi_pending;
+        Registers registers;
+    };
+
+    // A whole base file, with where it and its delta file go, or a record
+    struct Job
+    {
+        FILE* base = nullptr; // open on base_path + ".tmp"
+        std::string base_path;
+        std::string delta_path;
+        std::vector<U8> bytes;
+    };
+
+    CPU* cpu;
+    Memory* mem;
+    U32 next_sequence = 0;
+    U64 base_cycles = 0;
+    long delta_valid = 0; // bytes of the delta file holding whole records:
+                          // those load() used, then the writer's
+    FILE* delta = nullptr; // the writer's, or finish()'s once it is stopped
+
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Job> queue;
+    bool stopping = false;
+    std::atomic<bool> write_failed = false;
+
+    void put_state(std::vector<U8>& out);
+    static bool get_state(const U8*& p, const U8* end, State& state);
+    void set_state(const State& state);
+    void push(Job&& job);
+    void drain();
+    bool write_base(Job& job);
+};
@@ -1,16 +1,437 @@
 #include "cpu.hpp"
+#include "cpu_ops.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Interpreter core, picked at build time (see DISPATCH in the Makefile):
+//   CPU_DISPATCH_TABLE  - addressing mode and handler through the member
+//                         function pointer tables
+//   CPU_DISPATCH_SWITCH - one switch on the opcode byte
+//   default             - computed goto where the compiler supports it,
+//                         otherwise the switch
+// The switch and goto cores run the fused op<> handlers from cpu_ops.hpp.
+#if !defined(CPU_DISPATCH_TABLE) && !defined(CPU_DISPATCH_SWITCH) &&          \
+    !defined(__GNUC__)
+#define CPU_DISPATCH_SWITCH
+#endif
+
+int CPU::execute(int num_cycles) { return run<false>(num_cycles, -1); }
+
+int CPU::execute_until(int num_cycles, U16 stop_pc)
+{
+    return run<true>(num_cycles, stop_pc);
+}
+
+// Runs until num_cycles have been spent or a stop condition holds. The
+// instruction at PC is not checked, so a run can go on from where the last
+// one stopped. Without stop opcodes this runs the same cores as execute();
+// breakpoints and watchpoints are found from Memory's slow paths.
+StopInfo CPU::run_until(int num_cycles)
+{
+    watching = true;
+    resume_pc = PC;
+    resume_cycle = cycle_count;
+    int cycles = opcode_stop_count ? run<true>(num_cycles, -1)
+                                   : run<false>(num_cycles, -1);
+    watching = false;
+    resume_pc = -1;
+    StopInfo info = stop;
+    if (!info.reason)
+        info.reason = STOP_CYCLES;
+    info.cycles = cycles;
+    return info;
+}
+
+// Runs until num_cycles have been spent, run_until() found a stop condition
+// or, with STOP, PC reaches stop_pc or a stop opcode. The cores run in
+// slices up to the next event deadline; due events and pending interrupts
+// are handled between slices. Returns the cycles spent.
+template <bool STOP> int CPU::run(int num_cycles, int stop_pc)
+{
+    U64 start = cycle_count;
+    U64 end = start + (num_cycles > 0 ? num_cycles : 0);
+    until_pc = stop_pc;
+    stop = StopInfo();
+    while (cycle_count < end && !stop.reason && !(STOP && PC == stop_pc))
+    {
+        Event event;
+        while (scheduler.pop_due(cycle_count, event))
+            event.callback(event.context, *this);
+        if (nmi_pending)
+        {
+            nmi_pending = false;
+            interrupt(nmiVector);
+            continue;
+        }
+        if (irq_lines && !get_flag(INTERRUPT_DISABLE))
+        {
+            interrupt(irqVector);
+            continue;
+        }
+
+        slice_end = std::min(end, scheduler.next_deadline());
+        // A masked IRQ is looked at again after every instruction
+        if (irq_lines)
+            slice_end = std::min(slice_end, cycle_count + 1);
+        if (profile || trace || coverage)
+            execute_core<STOP, true>();
+        else if (block_cache)
+            execute_blocks<STOP>();
+        else
+            execute_core<STOP, false>();
+    }
+    until_pc = -1;
+    return cycle_count - start;
+}
+
+// Fetch from a page without a read_map entry: a device, unmapped, or one
+// holding a breakpoint or read watchpoint
+bool CPU::fetch_slow(U8& opcode)
+{
+    if ((mem->page_flags[PC >> 8] & PAGE_BREAK) && watching &&
+        ((break_bits[PC >> 6] >> (PC & 63)) & 1) && !resuming())
+    {
+        stop.reason = STOP_BREAKPOINT;
+        stop.address = PC;
+        return false;
+    }
+    opcode = mem->read_slow(PC);
+    return true;
+}
+
+// Called by Memory when a watched address is accessed. Outside run_until()
+// hits are ignored; inside, the first one ends the run after the current
+// instruction.
+void CPU::watch_hit(void* context, U16 address, bool write)
+{
+    CPU* cpu = (CPU*)context;
+    if (!cpu->watching || cpu->stop.reason)
+        return;
+    cpu->stop.reason = write ? STOP_WRITE_WATCH : STOP_READ_WATCH;
+    cpu->stop.address = address;
+    cpu->end_slice();
+}
+
+void CPU::set_breakpoint(U16 pc, bool set)
+{
+    if (!break_bits)
+    {
+        if (!set)
+            return;
+        break_bits = new U64[0x10000 / 64]();
+    }
+    U64 bit = (U64)1 << (pc & 63);
+    U64& word = break_bits[pc >> 6];
+    word = set ? word | bit : word & ~bit;
+    U8 page = pc >> 8;
+    const U64* bits = break_bits + (page << 2);
+    bool any = bits[0] | bits[1] | bits[2] | bits[3];
+    if (any == !!(mem->page_flags[page] & PAGE_BREAK))
+        return;
+    mem->set_page_flag(page, PAGE_BREAK, any);
+    // Cached blocks don't fetch, and none are made on trapped pages
+    if (block_cache)
+        block_cache->invalidate_page(page);
+}
+
+void CPU::set_watchpoint(U16 address, U8 kinds)
+{
+    mem->on_watch = &CPU::watch_hit;
+    mem->watch_context = this;
+    U8 page = address >> 8;
+    bool was_read = mem->page_flags[page] & PAGE_WATCH_READ;
+    mem->watch(address, kinds);
+    // Native code reads watched pages through the fused handlers, see
+    // BlockCompiler::native()
+    if (jit && block_cache && !was_read &&
+        (mem->page_flags[page] & PAGE_WATCH_READ))
+        for (auto& entry : block_cache->blocks)
+            entry.second.native = nullptr;
+}
+
+void CPU::stop_on_opcode(U8 opcode, bool stop)
+{
+    StopReason reason = stop ? opcode ? STOP_OPCODE : STOP_BRK : STOP_NONE;
+    opcode_stop_count += (reason != STOP_NONE) - (opcode_stops[opcode] != 0);
+    opcode_stops[opcode] = reason;
+}
+
+void CPU::stop_on_brk(bool stop) { stop_on_opcode(0x00, stop); }
 
-void CPU::execute(int num_cycles)
+void CPU::clear_stops()
 {
-    int cycles = 0;
-    while (cycles < num_cycles)
+    if (break_bits)
+        for (int pc = 0; pc < 0x10000; pc++)
+            if ((break_bits[pc >> 6] >> (pc & 63)) & 1)
+                set_breakpoint(pc, false);
+    if (mem->watch_map)
+        for (int address = 0; address < 0x10000; address++)
+            if (mem->watch_map[address])
+                set_watchpoint(address, 0);
+    for (int opcode = 0; opcode < 256; opcode++)
+        stop_on_opcode(opcode, false);
+}
+
+static bool transfers_control(const OpcodeInfo& info)
+{
+    switch (info.mnemonic)
     {
-        U8 opcode = read_byte(PC++);
-        (this->*code[(int)opcode])((this->*addressing_mode[(int)opcode])());
-        cycles += cycle_number[(int)opcode];
+    case Mnemonic::BRK:
+    case Mnemonic::JMP:
+    case Mnemonic::JSR:
+    case Mnemonic::RTI:
+    case Mnemonic::RTS:
+        return true;
+    default:
+        return info.mode == Mode::relative;
     }
 }
 
+// Profiler, trace and coverage hook, called with PC past the opcode and the
+// instruction's cycles already counted
+inline void CPU::instrument(U8 opcode, U8 cycles)
+{
+    U16 pc = PC - 1;
+    if (coverage)
+    {
+        const OpcodeInfo& info = opcode_info[opcode];
+        if (pc != coverage_next)
+        {
+            U16 block = (pc * 0x9E3779B1u) >> 16;
+            coverage[block ^ coverage_prev]++;
+            coverage_prev = block >> 1;
+        }
+        coverage_next =
+            transfers_control(info) ? -1 : (U16)(pc + info.length);
+    }
+    if (profile)
+        profile->count(pc, opcode, cycles);
+    if (trace)
+    {
+        int length = opcode_info[opcode].length;
+        U64 start = cycle_count - cycles;
+        TraceRecord record;
+        record.cycle_lo = start;
+        record.cycle_hi = start >> 32;
+        record.pc = pc;
+        record.opcode = opcode;
+        record.operand[0] = length > 1 ? mem->peek(PC) : 0;
+        record.operand[1] = length > 2 ? mem->peek(PC + 1) : 0;
+        record.a = A;
+        record.x = X;
+        record.y = Y;
+        record.sp = SP;
+        record.p = get_status();
+        trace->push(record);
+    }
+}
+
+// Runs instructions until cycle_count reaches slice_end or, with STOP, a stop
+// condition holds. An instruction's cycles are counted before it runs, so
+// devices see the cycle it ends on.
+template <bool STOP, bool INSTRUMENT> void CPU::execute_core()
+{
+#if defined(CPU_DISPATCH_TABLE)
+    while (cycle_count < slice_end && !(STOP && PC == until_pc))
+    {
+        U8 opcode;
+        if (!fetch<STOP>(opcode))
+            return;
+        const ReferenceOp& op = reference_ops[opcode];
+        cycle_count += opcode_info[opcode].cycles;
+        if constexpr (INSTRUMENT)
+            instrument(opcode, opcode_info[opcode].cycles);
+        (this->*op.execute)((this->*op.address)());
+    }
+#elif defined(CPU_DISPATCH_SWITCH)
+    while (cycle_count < slice_end && !(STOP && PC == until_pc))
+    {
+        U8 opcode;
+        if (!fetch<STOP>(opcode))
+            return;
+        cycle_count += opcode_info[opcode].cycles;
+        if constexpr (INSTRUMENT)
+            instrument(opcode, opcode_info[opcode].cycles);
+        dispatch(opcode);
+    }
+#else
+#define X(code, mnemonic, mode, cycles) &&L_##code,
+    static void* const labels[256] = {OPCODE_LIST(X)};
+#undef X
+    U8 opcode;
+#define DISPATCH()                                                             \
+    if (cycle_count >= slice_end || (STOP && PC == until_pc) ||                \
+        !fetch<STOP>(opcode))                                                  \
+        return;                                                                \
+    cycle_count += opcode_info[opcode].cycles;                                 \
+    if constexpr (INSTRUMENT)                                                  \
+        instrument(opcode, opcode_info[opcode].cycles);                        \
+    goto* labels[opcode];
+
+    DISPATCH();
+#define X(code, mnemonic, mode, cycles)                                        \
+    L_##code : op<Mnemonic::mnemonic, Mode::mode>(fetch_operand<Mode::mode>()); \
+    DISPATCH();
+    OPCODE_LIST(X)
+#undef X
+#undef DISPATCH
+#endif
+}
+
+// Pushes PC and P (B clear) and continues at the vector, like the 6502's
+// seven cycle interrupt sequence
+void CPU::interrupt(U16 vector)
+{
+    stack_push((PC >> 8) & 0xFF);
+    stack_push(PC & 0xFF);
+    stack_push((get_status() & ~(1 << BREAK_COMMAND)) | (1 << UNUSED));
+    set_flag(INTERRUPT_DISABLE, 1);
+    PC = read_word(vector);
+    cycle_count += 7;
+}
+
+// Makes the running slice end after the current instruction
+void CPU::end_slice()
+{
+    slice_end = cycle_count;
+    if (block_cache)
+        block_cache->invalidated = true;
+}
+
+U32 CPU::schedule(U64 when, EventCallback callback, void* context)
+{
+    U32 id = scheduler.schedule(when, callback, context);
+    if (when < slice_end)
+        end_slice();
+    return id;
+}
+
+void CPU::enable_profiler(bool enable)
+{
+    if (enable && !profile)
+        profile = new Profiler();
+    else if (!enable)
+    {
+        delete profile;
+        profile = nullptr;
+    }
+}
+
+void CPU::set_coverage(U8* map)
+{
+    coverage = map;
+    coverage_prev = 0;
+    coverage_next = -1;
+}
+
+bool CPU::start_trace(const char* path)
+{
+    if (!trace)
+        trace = new TraceWriter();
+    if (trace->open(path))
+        return true;
+    stop_trace();
+    return false;
+}
+
+void CPU::stop_trace()
+{
+    delete trace;
+    trace = nullptr;
+}
+
+bool CPU::cancel_event(U32 id) { return scheduler.cancel(id); }
+
+void CPU::set_irq(bool level, int source)
+{
+    if (level)
+    {
+        irq_lines |= 1 << source;
+        end_slice();
+    }
+    else
+        irq_lines &= ~(1 << source);
+}
+
+void CPU::trigger_nmi()
+{
+    nmi_pending = true;
+    end_slice();
+}
+
+void CPU::step()
+{
+    U8 opcode = read_byte(PC++);
+    cycle_count += opcode_info[opcode].cycles;
+    dispatch(opcode);
+}
+
+void CPU::step_reference()
+{
+    U8 opcode = read_byte(PC++);
+    const ReferenceOp& op = reference_ops[opcode];
+    (this->*op.execute)((this->*op.address)());
+}
+
+// Runs the next instruction through the handler tables, rewinds, and runs it
+// again through the fused handlers. Returns whether both left the same
+// registers and memory; the machine is left in the fused result.
+bool CPU::verify_step()
+{
+    U16 pc = PC;
+    U8 a = A, x = X, y = Y, sp = SP, status = get_status();
+    std::vector<U8> before(mem->memory, mem->memory + mem->mem_size);
+
+    step_reference();
+    U16 ref_pc = PC;
+    U8 ref_a = A, ref_x = X, ref_y = Y, ref_sp = SP;
+    U8 ref_status = get_status();
+    std::vector<U8> reference(mem->memory, mem->memory + mem->mem_size);
+
+    memcpy(mem->memory, before.data(), before.size());
+    PC = pc, A = a, X = x, Y = y, SP = sp;
+    set_status(status);
+    step();
+
+    bool same = PC == ref_pc && A == ref_a && X == ref_x && Y == ref_y &&
+                SP == ref_sp && get_status() == ref_status &&
+                !memcmp(mem->memory, reference.data(), reference.size());
+    if (!same)
+        printf("Mismatch: opcode %.2X at %.4X\n", before[pc], pc);
+    return same;
+}
+
+// Checks every legal opcode against its table handler from a spread of
+// register, flag and operand values. Clobbers registers and memory; returns
+// the number of opcodes that disagree.
+int CPU::verify_opcodes()
+{
+    int failed = 0;
+    U32 seed = 0x6502;
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        if (opcode_info[opcode].mnemonic == Mnemonic::ILLEGAL)
+            continue;
+        bool same = true;
+        for (int run = 0; run < 64; run++)
+        {
+            for (U32 i = 0; i < mem->mem_size; i++)
+            {
+                seed = seed * 1103515245 + 12345;
+                mem->memory[i] = seed >> 16;
+            }
+            PC = 0x0600;
+            mem->memory[PC] = opcode;
+            A = seed >> 8, X = seed >> 16, Y = seed >> 24, SP = seed;
+            set_status(seed >> 12);
+            same &= verify_step();
+        }
+        failed += !same;
+    }
+    return failed;
+}
+
 void CPU::print_registers()
 {
 	std::cout << "Registers: " << std::endl;
@@ -48,12 +469,9 @@ U8 CPU::stack_pop()
         SP = 0x00;
     else
         SP++;
-    return read_byte(0x00 + SP);
+    return read_byte(0x100 + SP);
 }
 
-void CPU::write_byte(U16 position, U8 value) { mem->memory[position] = value; }
-
-U8 CPU::read_byte(U16 position) { return mem->memory[position]; }
 
 void CPU::write_word(U16 position, U16 value)
 {
@@ -73,44 +491,82 @@ void CPU::write_word(U16 position, U16 value)
     write_byte(position + 1, second_byte);
 }
 
-U16 CPU::read_word(U16 position)
+U8 CPU::get_status()
 {
-    U8 first_byte = read_byte(position);
-    U8 second_byte = read_byte(position + 1);
-    if (is_little_endian)
-        return (first_byte | (second_byte << 8));
-    return (second_byte | (first_byte << 8));
+    return (processor_status & 0x3C) | flag_c | ((flag_z == 0) << ZERO_FLAG) |
+           (flag_v << OVERFLOW_FLAG) | (flag_n & BIT_7_MASK);
 }
 
-void CPU::set_flag(int flag, int val)
+void CPU::set_status(U8 status)
 {
-    if (val)
-        processor_status |= (1 << flag);
-    else
-        processor_status &= ~(1 << flag);
+    processor_status = status;
+    flag_c = (status >> CARRY_FLAG) & 1;
+    flag_z = !(status & (1 << ZERO_FLAG));
+    flag_v = (status >> OVERFLOW_FLAG) & 1;
+    flag_n = status;
 }
 
-int CPU::get_flag(int flag) { return ((processor_status & (1 << flag)) != 0); }
-
 void CPU::print_flags()
 {
     std::cout << "Flags:" << std::endl;
 	std::cout << "C  Z  I  D  B  -  V  N" << std::endl;
+    U8 status = get_status();
 	for(int i = 0; i < 8; i++){
-		std::cout << ((processor_status & (1 << i)) != 0) << "  ";
+		std::cout << ((status & (1 << i)) != 0) << "  ";
 	}
     std::cout << std::endl << std::endl;
 }
 
+Registers CPU::get_registers()
+{
+    Registers r;
+    r.PC = PC;
+    r.A = A;
+    r.X = X;
+    r.Y = Y;
+    r.SP = SP;
+    r.P = get_status();
+    return r;
+}
+
+void CPU::set_registers(const Registers& r)
+{
+    PC = r.PC;
+    A = r.A;
+    X = r.X;
+    Y = r.Y;
+    SP = r.SP;
+    set_status(r.P);
+}
+
+void CPU::snapshot()
+{
+    saved_registers = get_registers();
+    mem->snapshot();
+}
+
+void CPU::restore()
+{
+    mem->restore();
+    set_registers(saved_registers);
+}
+
 void CPU::reset()
 {
     PC = 0x0600;
     A = 0, Y = 0, X = 0;
     SP = 0xFF;
-    processor_status = 0x00;
+    set_status(0x00);
 }
 
-void CPU::check_endian()
+// reset(), then start from the address in the reset vector
+void CPU::reset_to_vector()
+{
+    reset();
+    PC = read_word(resetVector);
+}
+
+int CPU::host_is_little_endian()
 {
     union
     {
@@ -118,10 +574,12 @@ void CPU::check_endian()
         char c[4];
     } bint = {0x01020304};
 
-    if (bint.c[0] == 1)
-        is_little_endian = 0;
-    else
-        is_little_endian = 1;
+    return bint.c[0] != 1;
+}
+
+void CPU::check_endian()
+{
+    is_little_endian = host_is_little_endian();
     std::cout << "Little Endian: " << is_little_endian << std::endl;
 }
 
@@ -155,11 +613,20 @@ CPU::CPU(Memory* memory)
     SP = 0;
     X = 0;
     Y = 0;
-    processor_status = 0;
-    startup_info();
-    check_endian();
+    set_status(0);
+    is_little_endian = host_is_little_endian();
     reset();
-    mem->load_bin_file();
+}
+
+CPU::~CPU()
+{
+    delete profile;
+    delete trace;
+    enable_jit(false);
+    delete block_cache;
+    delete[] break_bits;
+    if (mem && mem->watch_context == this)
+        mem->on_watch = nullptr;
 }
 
 U16 CPU::implied() { return 0; }
@@ -219,35 +686,285 @@ U16 CPU::relative()
 
 U16 CPU::illegal_mode() { return 0; }
 
+// OPCODE numbers taken from https://www.pagetable.com/c64ref/6502/?tab=3
+constexpr CPU::ReferenceOp CPU::reference_ops[256] = {
+    {&CPU::OPCODE_BRK,     &CPU::implied},      // 00
+    {&CPU::OPCODE_ORA,     &CPU::inx},          // 01
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 02
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 03
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 04
+    {&CPU::OPCODE_ORA,     &CPU::zero_page},    // 05
+    {&CPU::OPCODE_ASL,     &CPU::zero_page},    // 06
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 07
+    {&CPU::OPCODE_PHP,     &CPU::implied},      // 08
+    {&CPU::OPCODE_ORA,     &CPU::immediate},    // 09
+    {&CPU::OPCODE_ASL_ACC, &CPU::accumulator},  // 0A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 0B
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 0C
+    {&CPU::OPCODE_ORA,     &CPU::absolute},     // 0D
+    {&CPU::OPCODE_ASL,     &CPU::absolute},     // 0E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 0F
+    {&CPU::OPCODE_BPL,     &CPU::relative},     // 10
+    {&CPU::OPCODE_ORA,     &CPU::iny},          // 11
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 12
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 13
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 14
+    {&CPU::OPCODE_ORA,     &CPU::zero_x},       // 15
+    {&CPU::OPCODE_ASL,     &CPU::zero_x},       // 16
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 17
+    {&CPU::OPCODE_CLC,     &CPU::implied},      // 18
+    {&CPU::OPCODE_ORA,     &CPU::abs_y},        // 19
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 1A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 1B
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 1C
+    {&CPU::OPCODE_ORA,     &CPU::abs_x},        // 1D
+    {&CPU::OPCODE_ASL,     &CPU::abs_x},        // 1E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 1F
+    {&CPU::OPCODE_JSR,     &CPU::absolute},     // 20
+    {&CPU::OPCODE_AND,     &CPU::inx},          // 21
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 22
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 23
+    {&CPU::OPCODE_BIT,     &CPU::zero_page},    // 24
+    {&CPU::OPCODE_AND,     &CPU::zero_page},    // 25
+    {&CPU::OPCODE_ROL,     &CPU::zero_page},    // 26
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 27
+    {&CPU::OPCODE_PLP,     &CPU::implied},      // 28
+    {&CPU::OPCODE_AND,     &CPU::immediate},    // 29
+    {&CPU::OPCODE_ROL_ACC, &CPU::accumulator},  // 2A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 2B
+    {&CPU::OPCODE_BIT,     &CPU::absolute},     // 2C
+    {&CPU::OPCODE_AND,     &CPU::absolute},     // 2D
+    {&CPU::OPCODE_ROL,     &CPU::absolute},     // 2E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 2F
+    {&CPU::OPCODE_BMI,     &CPU::relative},     // 30
+    {&CPU::OPCODE_AND,     &CPU::iny},          // 31
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 32
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 33
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 34
+    {&CPU::OPCODE_AND,     &CPU::zero_x},       // 35
+    {&CPU::OPCODE_ROL,     &CPU::zero_x},       // 36
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 37
+    {&CPU::OPCODE_SEC,     &CPU::implied},      // 38
+    {&CPU::OPCODE_AND,     &CPU::abs_y},        // 39
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 3A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 3B
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 3C
+    {&CPU::OPCODE_AND,     &CPU::abs_x},        // 3D
+    {&CPU::OPCODE_ROL,     &CPU::abs_x},        // 3E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 3F
+    {&CPU::OPCODE_RTI,     &CPU::implied},      // 40
+    {&CPU::OPCODE_EOR,     &CPU::inx},          // 41
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 42
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 43
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 44
+    {&CPU::OPCODE_EOR,     &CPU::zero_page},    // 45
+    {&CPU::OPCODE_LSR,     &CPU::zero_page},    // 46
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 47
+    {&CPU::OPCODE_PHA,     &CPU::implied},      // 48
+    {&CPU::OPCODE_EOR,     &CPU::immediate},    // 49
+    {&CPU::OPCODE_LSR_ACC, &CPU::accumulator},  // 4A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 4B
+    {&CPU::OPCODE_JMP,     &CPU::absolute},     // 4C
+    {&CPU::OPCODE_EOR,     &CPU::absolute},     // 4D
+    {&CPU::OPCODE_LSR,     &CPU::absolute},     // 4E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 4F
+    {&CPU::OPCODE_BVC,     &CPU::relative},     // 50
+    {&CPU::OPCODE_EOR,     &CPU::iny},          // 51
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 52
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 53
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 54
+    {&CPU::OPCODE_EOR,     &CPU::zero_x},       // 55
+    {&CPU::OPCODE_LSR,     &CPU::zero_x},       // 56
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 57
+    {&CPU::OPCODE_CLI,     &CPU::implied},      // 58
+    {&CPU::OPCODE_EOR,     &CPU::abs_y},        // 59
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 5A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 5B
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 5C
+    {&CPU::OPCODE_EOR,     &CPU::abs_x},        // 5D
+    {&CPU::OPCODE_LSR,     &CPU::abs_x},        // 5E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 5F
+    {&CPU::OPCODE_RTS,     &CPU::implied},      // 60
+    {&CPU::OPCODE_ADC,     &CPU::inx},          // 61
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 62
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 63
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 64
+    {&CPU::OPCODE_ADC,     &CPU::zero_page},    // 65
+    {&CPU::OPCODE_ROR,     &CPU::zero_page},    // 66
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 67
+    {&CPU::OPCODE_PLA,     &CPU::implied},      // 68
+    {&CPU::OPCODE_ADC,     &CPU::immediate},    // 69
+    {&CPU::OPCODE_ROR_ACC, &CPU::accumulator},  // 6A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 6B
+    {&CPU::OPCODE_JMP,     &CPU::abs_indirect}, // 6C
+    {&CPU::OPCODE_ADC,     &CPU::absolute},     // 6D
+    {&CPU::OPCODE_ROR,     &CPU::absolute},     // 6E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 6F
+    {&CPU::OPCODE_BVS,     &CPU::relative},     // 70
+    {&CPU::OPCODE_ADC,     &CPU::iny},          // 71
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 72
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 73
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 74
+    {&CPU::OPCODE_ADC,     &CPU::zero_x},       // 75
+    {&CPU::OPCODE_ROR,     &CPU::zero_x},       // 76
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 77
+    {&CPU::OPCODE_SEI,     &CPU::implied},      // 78
+    {&CPU::OPCODE_ADC,     &CPU::abs_y},        // 79
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 7A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 7B
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 7C
+    {&CPU::OPCODE_ADC,     &CPU::abs_x},        // 7D
+    {&CPU::OPCODE_ROR,     &CPU::abs_x},        // 7E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 7F
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 80
+    {&CPU::OPCODE_STA,     &CPU::inx},          // 81
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 82
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 83
+    {&CPU::OPCODE_STY,     &CPU::zero_page},    // 84
+    {&CPU::OPCODE_STA,     &CPU::zero_page},    // 85
+    {&CPU::OPCODE_STX,     &CPU::zero_page},    // 86
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 87
+    {&CPU::OPCODE_DEY,     &CPU::implied},      // 88
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 89
+    {&CPU::OPCODE_TXA,     &CPU::implied},      // 8A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 8B
+    {&CPU::OPCODE_STY,     &CPU::absolute},     // 8C
+    {&CPU::OPCODE_STA,     &CPU::absolute},     // 8D
+    {&CPU::OPCODE_STX,     &CPU::absolute},     // 8E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 8F
+    {&CPU::OPCODE_BCC,     &CPU::relative},     // 90
+    {&CPU::OPCODE_STA,     &CPU::iny},          // 91
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 92
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 93
+    {&CPU::OPCODE_STY,     &CPU::zero_x},       // 94
+    {&CPU::OPCODE_STA,     &CPU::zero_x},       // 95
+    {&CPU::OPCODE_STX,     &CPU::zero_y},       // 96
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 97
+    {&CPU::OPCODE_TYA,     &CPU::implied},      // 98
+    {&CPU::OPCODE_STA,     &CPU::abs_y},        // 99
+    {&CPU::OPCODE_TXS,     &CPU::implied},      // 9A
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 9B
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 9C
+    {&CPU::OPCODE_STA,     &CPU::abs_x},        // 9D
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 9E
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // 9F
+    {&CPU::OPCODE_LDY,     &CPU::immediate},    // A0
+    {&CPU::OPCODE_LDA,     &CPU::inx},          // A1
+    {&CPU::OPCODE_LDX,     &CPU::immediate},    // A2
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // A3
+    {&CPU::OPCODE_LDY,     &CPU::zero_page},    // A4
+    {&CPU::OPCODE_LDA,     &CPU::zero_page},    // A5
+    {&CPU::OPCODE_LDX,     &CPU::zero_page},    // A6
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // A7
+    {&CPU::OPCODE_TAY,     &CPU::implied},      // A8
+    {&CPU::OPCODE_LDA,     &CPU::immediate},    // A9
+    {&CPU::OPCODE_TAX,     &CPU::implied},      // AA
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // AB
+    {&CPU::OPCODE_LDY,     &CPU::absolute},     // AC
+    {&CPU::OPCODE_LDA,     &CPU::absolute},     // AD
+    {&CPU::OPCODE_LDX,     &CPU::absolute},     // AE
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // AF
+    {&CPU::OPCODE_BCS,     &CPU::relative},     // B0
+    {&CPU::OPCODE_LDA,     &CPU::iny},          // B1
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // B2
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // B3
+    {&CPU::OPCODE_LDY,     &CPU::zero_x},       // B4
+    {&CPU::OPCODE_LDA,     &CPU::zero_x},       // B5
+    {&CPU::OPCODE_LDX,     &CPU::zero_y},       // B6
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // B7
+    {&CPU::OPCODE_CLV,     &CPU::implied},      // B8
+    {&CPU::OPCODE_LDA,     &CPU::abs_y},        // B9
+    {&CPU::OPCODE_TSX,     &CPU::implied},      // BA
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // BB
+    {&CPU::OPCODE_LDY,     &CPU::abs_x},        // BC
+    {&CPU::OPCODE_LDA,     &CPU::abs_x},        // BD
+    {&CPU::OPCODE_LDX,     &CPU::abs_y},        // BE
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // BF
+    {&CPU::OPCODE_CPY,     &CPU::immediate},    // C0
+    {&CPU::OPCODE_CMP,     &CPU::inx},          // C1
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // C2
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // C3
+    {&CPU::OPCODE_CPY,     &CPU::zero_page},    // C4
+    {&CPU::OPCODE_CMP,     &CPU::zero_page},    // C5
+    {&CPU::OPCODE_DEC,     &CPU::zero_page},    // C6
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // C7
+    {&CPU::OPCODE_INY,     &CPU::implied},      // C8
+    {&CPU::OPCODE_CMP,     &CPU::immediate},    // C9
+    {&CPU::OPCODE_DEX,     &CPU::implied},      // CA
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // CB
+    {&CPU::OPCODE_CPY,     &CPU::absolute},     // CC
+    {&CPU::OPCODE_CMP,     &CPU::absolute},     // CD
+    {&CPU::OPCODE_DEC,     &CPU::absolute},     // CE
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // CF
+    {&CPU::OPCODE_BNE,     &CPU::relative},     // D0
+    {&CPU::OPCODE_CMP,     &CPU::iny},          // D1
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // D2
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // D3
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // D4
+    {&CPU::OPCODE_CMP,     &CPU::zero_x},       // D5
+    {&CPU::OPCODE_DEC,     &CPU::zero_x},       // D6
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // D7
+    {&CPU::OPCODE_CLD,     &CPU::implied},      // D8
+    {&CPU::OPCODE_CMP,     &CPU::abs_y},        // D9
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // DA
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // DB
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // DC
+    {&CPU::OPCODE_CMP,     &CPU::abs_x},        // DD
+    {&CPU::OPCODE_DEC,     &CPU::abs_x},        // DE
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // DF
+    {&CPU::OPCODE_CPX,     &CPU::immediate},    // E0
+    {&CPU::OPCODE_SBC,     &CPU::inx},          // E1
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // E2
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // E3
+    {&CPU::OPCODE_CPX,     &CPU::zero_page},    // E4
+    {&CPU::OPCODE_SBC,     &CPU::zero_page},    // E5
+    {&CPU::OPCODE_INC,     &CPU::zero_page},    // E6
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // E7
+    {&CPU::OPCODE_INX,     &CPU::implied},      // E8
+    {&CPU::OPCODE_SBC,     &CPU::immediate},    // E9
+    {&CPU::OPCODE_NOP,     &CPU::implied},      // EA
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // EB
+    {&CPU::OPCODE_CPX,     &CPU::absolute},     // EC
+    {&CPU::OPCODE_SBC,     &CPU::absolute},     // ED
+    {&CPU::OPCODE_INC,     &CPU::absolute},     // EE
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // EF
+    {&CPU::OPCODE_BEQ,     &CPU::relative},     // F0
+    {&CPU::OPCODE_SBC,     &CPU::iny},          // F1
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // F2
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // F3
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // F4
+    {&CPU::OPCODE_SBC,     &CPU::zero_x},       // F5
+    {&CPU::OPCODE_INC,     &CPU::zero_x},       // F6
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // F7
+    {&CPU::OPCODE_SED,     &CPU::implied},      // F8
+    {&CPU::OPCODE_SBC,     &CPU::abs_y},        // F9
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // FA
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // FB
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // FC
+    {&CPU::OPCODE_SBC,     &CPU::abs_x},        // FD
+    {&CPU::OPCODE_INC,     &CPU::abs_x},        // FE
+    {&CPU::OPCODE_ILLEGAL, &CPU::illegal_mode}, // FF
+};
+
+// The reference ADC and SBC compute decimal results directly; the fused
+// handlers look them up, and verify_opcodes() checks one against the other
 void CPU::OPCODE_ADC(U16 in)
 {
-    U16 m = read_byte(in);
-    U8 is_carry = (get_flag(CARRY_FLAG) != 0);
-    unsigned int total = (m + A + is_carry);
-    set_flag(CARRY_FLAG, total > 0xFF);
-    if (get_flag(DECIMAL_MODE))
-    {
-        if (total & 0x0F > 0x09)
-            total += 0x06;
-        set_flag(CARRY_FLAG, total > 0x99);
-        if (total & 0xF0 > 0x90)
-            total += 0x60;
-    }
-    U8 is_overflow = ((!((A ^ m) & BIT_7_MASK)) && ((A ^ total) & BIT_7_MASK));
-    set_flag(OVERFLOW_FLAG, is_overflow);
-    set_flag(NEGATIVE_FLAG, total & BIT_7_MASK);
-    total &= 0xFF;
-    set_flag(ZERO_FLAG, !total);
-
-    A = total;
+    U8 m = read_byte(in);
+    U8 carry = get_flag(CARRY_FLAG);
+    U16 r = get_flag(DECIMAL_MODE) ? alu_add_decimal(A, m, carry)
+                                   : alu_add(A, m, carry);
+    set_flag(CARRY_FLAG, r & ALU_C);
+    set_flag(OVERFLOW_FLAG, r & ALU_V);
+    set_nz(!(r & ALU_Z), r & ALU_N ? BIT_7_MASK : 0);
+    A = r & 0xFF;
 }
 
 void CPU::OPCODE_AND(U16 in)
 {
     // U8 m = A & mem->memory[in];
     U8 m = A & read_byte(in);
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     A = m;
 }
 
@@ -256,8 +973,7 @@ void CPU::OPCODE_ASL(U16 in)
     U8 m = read_byte(in);
     set_flag(CARRY_FLAG, m & BIT_7_MASK);
     m = (m << 1) & 0xFF;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     write_byte(in, m);
 }
 
@@ -265,8 +981,7 @@ void CPU::OPCODE_ASL_ACC(U16 in)
 {
     set_flag(CARRY_FLAG, A & BIT_7_MASK);
     A = (A << 1) & 0xFF;
-    set_flag(ZERO_FLAG, !A);
-    set_flag(NEGATIVE_FLAG, A & BIT_7_MASK);
+    set_nz(A);
 }
 
 void CPU::OPCODE_BCC(U16 in)
@@ -297,9 +1012,8 @@ void CPU::OPCODE_BIT(U16 in)
 {
     U8 r = read_byte(in);
     U8 m = A & r;
-    set_flag(ZERO_FLAG, !m);
     set_flag(OVERFLOW_FLAG, r & BIT_6_MASK);
-    set_flag(NEGATIVE_FLAG, r & BIT_7_MASK);
+    set_nz(m, r);
 }
 
 void CPU::OPCODE_BMI(U16 in)
@@ -332,7 +1046,7 @@ void CPU::OPCODE_BRK(U16 in)
     set_flag(BREAK_COMMAND, 1);
     stack_push((PC >> 8) & 0xFF);
     stack_push(PC & 0xFF);
-    stack_push(processor_status);
+    stack_push(get_status());
     PC = read_word(irqVector);
 }
 
@@ -363,59 +1077,52 @@ void CPU::OPCODE_CLV(U16 in) { set_flag(OVERFLOW_FLAG, 0); }
 void CPU::OPCODE_CMP(U16 in)
 {
     U8 m = read_byte(in);
-    set_flag(ZERO_FLAG, A == m);
     set_flag(CARRY_FLAG, A >= m);
     int result = A - m;
-    set_flag(NEGATIVE_FLAG, result & BIT_7_MASK);
+    set_nz(result);
 }
 
 void CPU::OPCODE_CPX(U16 in)
 {
     U8 m = read_byte(in);
-    set_flag(ZERO_FLAG, X == m);
     set_flag(CARRY_FLAG, X >= m);
     int result = X - m;
-    set_flag(NEGATIVE_FLAG, result & BIT_7_MASK);
+    set_nz(result);
 }
 
 void CPU::OPCODE_CPY(U16 in)
 {
     U8 m = read_byte(in);
-    set_flag(ZERO_FLAG, Y == m);
     set_flag(CARRY_FLAG, Y >= m);
     unsigned int result = Y - m;
-    set_flag(NEGATIVE_FLAG, result & BIT_7_MASK);
+    set_nz(result);
 }
 
 void CPU::OPCODE_DEC(U16 in)
 {
     U8 m = read_byte(in);
     m = (m - 1) & 0xFF;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     write_byte(in, m);
 }
 
 void CPU::OPCODE_DEX(U16 in)
 {
     X = (X - 1) & 0xFF;
-    set_flag(ZERO_FLAG, !X);
-    set_flag(NEGATIVE_FLAG, X & BIT_7_MASK);
+    set_nz(X);
 }
 
 void CPU::OPCODE_DEY(U16 in)
 {
     Y = (Y - 1) & 0xFF;
-    set_flag(ZERO_FLAG, !Y);
-    set_flag(NEGATIVE_FLAG, Y & BIT_7_MASK);
+    set_nz(Y);
 }
 
 void CPU::OPCODE_EOR(U16 in)
 {
     U8 m = read_byte(in);
     U8 result = m ^ A;
-    set_flag(ZERO_FLAG, !result);
-    set_flag(NEGATIVE_FLAG, result & BIT_7_MASK);
+    set_nz(result);
     A = result;
 }
 
@@ -423,23 +1130,20 @@ void CPU::OPCODE_INC(U16 in)
 {
     U8 m = read_byte(in);
     m = (m + 1) & 0xFF;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     write_byte(in, m);
 }
 
 void CPU::OPCODE_INX(U16 in)
 {
     X = (X + 1) & 0xFF;
-    set_flag(ZERO_FLAG, !X);
-    set_flag(NEGATIVE_FLAG, X & BIT_7_MASK);
+    set_nz(X);
 }
 
 void CPU::OPCODE_INY(U16 in)
 {
     Y = (Y + 1) & 0xFF;
-    set_flag(ZERO_FLAG, !Y);
-    set_flag(NEGATIVE_FLAG, Y & BIT_7_MASK);
+    set_nz(Y);
 }
 
 void CPU::OPCODE_JMP(U16 in) { PC = in; }
@@ -455,8 +1159,7 @@ void CPU::OPCODE_JSR(U16 in)
 void CPU::OPCODE_LDA(U16 in)
 {
     U8 m = read_byte(in);
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
 
     A = m;
 }
@@ -464,16 +1167,14 @@ void CPU::OPCODE_LDA(U16 in)
 void CPU::OPCODE_LDX(U16 in)
 {
     U8 m = read_byte(in);
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     X = m;
 }
 
 void CPU::OPCODE_LDY(U16 in)
 {
     U8 m = read_byte(in);
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     Y = m;
 }
 
@@ -482,8 +1183,7 @@ void CPU::OPCODE_LSR(U16 in)
     U8 m = read_byte(in);
     set_flag(CARRY_FLAG, m & 0x01);
     m = (m >> 1) & 0xFF;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     write_byte(in, m);
 }
 
@@ -491,8 +1191,7 @@ void CPU::OPCODE_LSR_ACC(U16 in)
 {
     set_flag(CARRY_FLAG, A & 0x01);
     A = (A >> 1) & 0xFF;
-    set_flag(ZERO_FLAG, !A);
-    set_flag(NEGATIVE_FLAG, A & BIT_7_MASK);
+    set_nz(A);
 }
 
 void CPU::OPCODE_NOP(U16 in)
@@ -505,26 +1204,24 @@ void CPU::OPCODE_ORA(U16 in)
 {
     U8 m = read_byte(in);
     m |= A;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     A = m;
 }
 
 void CPU::OPCODE_PHA(U16 in) { stack_push(A); }
 
-void CPU::OPCODE_PHP(U16 in) { stack_push(processor_status); }
+void CPU::OPCODE_PHP(U16 in) { stack_push(get_status()); }
 
 void CPU::OPCODE_PLA(U16 in)
 {
     A = stack_pop();
-    set_flag(ZERO_FLAG, !A);
-    set_flag(NEGATIVE_FLAG, A & BIT_7_MASK);
+    set_nz(A);
 }
 
 void CPU::OPCODE_PLP(U16 in)
 {
     U8 m = stack_pop();
-    processor_status = m;
+    set_status(m);
 }
 
 void CPU::OPCODE_ROL(U16 in)
@@ -534,8 +1231,7 @@ void CPU::OPCODE_ROL(U16 in)
     m = (m << 1) & 0xFF;
     if (get_flag(CARRY_FLAG))
         m |= 0x01;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     set_flag(CARRY_FLAG, carry);
     write_byte(in, m);
 }
@@ -546,8 +1242,7 @@ void CPU::OPCODE_ROL_ACC(U16 in)
     A = (A << 1) & 0xFF;
     if (get_flag(CARRY_FLAG))
         A |= 0x01;
-    set_flag(ZERO_FLAG, !A);
-    set_flag(NEGATIVE_FLAG, A & BIT_7_MASK);
+    set_nz(A);
     set_flag(CARRY_FLAG, carry);
 }
 
@@ -558,8 +1253,7 @@ void CPU::OPCODE_ROR(U16 in)
     m = (m >> 1) & 0xFF;
     if (get_flag(CARRY_FLAG))
         m |= BIT_7_MASK;
-    set_flag(ZERO_FLAG, !m);
-    set_flag(NEGATIVE_FLAG, m & BIT_7_MASK);
+    set_nz(m);
     set_flag(CARRY_FLAG, carry);
     write_byte(in, m);
 }
@@ -570,15 +1264,14 @@ void CPU::OPCODE_ROR_ACC(U16 in)
     A = (A >> 1) & 0xFF;
     if (get_flag(CARRY_FLAG))
         A |= BIT_7_MASK;
-    set_flag(ZERO_FLAG, !A);
-    set_flag(NEGATIVE_FLAG, A & BIT_7_MASK);
+    set_nz(A);
     set_flag(CARRY_FLAG, carry);
 }
 
 void CPU::OPCODE_RTI(U16 in)
 {
     U8 l, h;
-    processor_status = stack_pop() | (1 << BREAK_COMMAND);
+    set_status(stack_pop() | (1 << BREAK_COMMAND));
     l = stack_pop();
     h = stack_pop();
     PC = ((h << 8) | l);
@@ -595,13 +1288,13 @@ void CPU::OPCODE_RTS(U16 in)
 void CPU::OPCODE_SBC(U16 in)
 {
     U8 m = read_byte(in);
-    U8 carry = (get_flag(CARRY_FLAG) != 0);
-    unsigned int result = (A - m - (1 - carry));
-	U8 is_overflow = ((((A ^ m) & BIT_7_MASK)) && ((A ^ result) & BIT_7_MASK));
-    set_flag(OVERFLOW_FLAG, is_overflow);
-	result &= 0xFF;
-    set_flag(ZERO_FLAG, !result);
-    set_flag(NEGATIVE_FLAG, result & BIT_7_MASK);
+    U8 carry = get_flag(CARRY_FLAG);
+    U16 r = get_flag(DECIMAL_MODE) ? alu_sub_decimal(A, m, carry)
+                                   : alu_sub(A, m, carry);
+    set_flag(CARRY_FLAG, r & ALU_C);
+    set_flag(OVERFLOW_FLAG, r & ALU_V);
+    set_nz(!(r & ALU_Z), r & ALU_N ? BIT_7_MASK : 0);
+    A = r & 0xFF;
 }
 
 void CPU::OPCODE_SEC(U16 in) { set_flag(CARRY_FLAG, 1); }
@@ -618,47 +1311,42 @@ void CPU::OPCODE_STY(U16 in) { write_byte(in, Y); }
 void CPU::OPCODE_TAX(U16 in)
 {
     X = A;
-    set_flag(ZERO_FLAG, !X);
-    set_flag(NEGATIVE_FLAG, X & BIT_7_MASK);
+    set_nz(X);
 }
 
 void CPU::OPCODE_TAY(U16 in)
 {
     Y = A;
-    set_flag(ZERO_FLAG, !Y);
-    set_flag(NEGATIVE_FLAG, Y & BIT_7_MASK);
+    set_nz(Y);
 }
 
 void CPU::OPCODE_TSX(U16 in)
 {
     X = SP;
-    set_flag(ZERO_FLAG, !X);
-    set_flag(NEGATIVE_FLAG, X & BIT_7_MASK);
+    set_nz(X);
 }
 
 void CPU::OPCODE_TXA(U16 in)
 {
     A = X;
-    set_flag(ZERO_FLAG, !X);
-    set_flag(NEGATIVE_FLAG, X & BIT_7_MASK);
+    set_nz(X);
 }
 
 void CPU::OPCODE_TXS(U16 in)
 {
     SP = X;
-    set_flag(ZERO_FLAG, !X);
-    set_flag(NEGATIVE_FLAG, X & BIT_7_MASK);
+    set_nz(X);
 }
 
 void CPU::OPCODE_TYA(U16 in)
 {
     A = Y;
-    set_flag(ZERO_FLAG, !Y);
-    set_flag(NEGATIVE_FLAG, Y & BIT_7_MASK);
+    set_nz(Y);
 }
 
 void CPU::OPCODE_ILLEGAL(U16 in)
 {
-    std::cout << "ILLEGAL OPCODE RUN" << std::endl;
+    if (report_illegal)
+        std::cout << "ILLEGAL OPCODE RUN" << std::endl;
     return;
 }
\ No newline at end of file
@@ -1,9 +1,15 @@
+#pragma once
 #include "memory.hpp"
+#include "opcodes.hpp"
+#include "profiler.hpp"
+#include "scheduler.hpp"
+#include "trace.hpp"
 #include <iostream>
 
 #define U8 uint8_t
 #define U16 uint16_t
 #define U32 uint32_t
+#define U64 uint64_t
 
 enum
 {
@@ -17,6 +23,66 @@ enum
     NEGATIVE_FLAG
 };
 
+class CPU;
+class BlockCache;
+struct Block;
+class Jit;
+
+// Native code for one block: runs it and returns the cycles it took, with PC
+// and registers written back
+typedef int (*JitCode)(CPU* cpu);
+
+struct BlockCacheStats
+{
+    U64 hits = 0;
+    U64 misses = 0;
+    U64 invalidations = 0; // blocks dropped because their code was written
+    U64 idle_skips = 0;    // times an idle loop was fast-forwarded
+    U64 idle_cycles = 0;   // cycles skipped that way
+};
+
+struct JitStats
+{
+    U64 compiled_blocks = 0;
+    U64 native_runs = 0; // blocks run as native code
+    U64 flushes = 0;     // times the code buffer filled up and was reset
+};
+
+// Why run_until() returned
+enum StopReason
+{
+    STOP_NONE,
+    STOP_CYCLES,      // the cycle budget ran out
+    STOP_BREAKPOINT,  // PC is on a breakpoint, the instruction has not run
+    STOP_BRK,         // PC is on a BRK, see stop_on_brk()
+    STOP_OPCODE,      // PC is on an opcode given to stop_on_opcode()
+    STOP_READ_WATCH,  // the last instruction read a watched address
+    STOP_WRITE_WATCH, // the last instruction wrote one
+};
+
+struct StopInfo
+{
+    StopReason reason = STOP_NONE;
+    U16 address = 0; // PC stopped at, or the watched address
+    int cycles = 0;  // cycles run
+};
+
+// Bytes in a coverage map, see CPU::set_coverage()
+const int COVERAGE_SIZE = 1 << 16;
+
+struct Registers
+{
+    U16 PC;
+    U8 A;
+    U8 X;
+    U8 Y;
+    U8 SP;
+    U8 P;
+};
+
+// A CPU only touches its own Memory and caches, so separate instances can
+// run on separate threads. The constructor is silent; startup_info(),
+// check_endian() and Memory::load_bin_file() are up to the caller.
 class CPU
 {
 public:
@@ -32,20 +98,126 @@ public:
     void print_flags();
     void print_registers();
     void print_stack();
-    void execute(int num_cycles);
+    U8 get_status();
+    void set_status(U8 status);
+    int execute(int num_cycles);
+    int execute_until(int num_cycles, U16 stop_pc);
+    StopInfo run_until(int num_cycles);
+    void step();
+    void step_reference();
+    bool verify_step();
+    int verify_opcodes();
     void reset();
+    void reset_to_vector();
+    Registers get_registers();
+    void set_registers(const Registers& r);
+    bool report_illegal = true; // print a line for each illegal opcode run
+    bool skip_idle = true; // fast-forward idle loops, see block_cache.cpp
+
+    Memory* memory() { return mem; }
+    // Cycles run since construction
+    U64 cycles() { return cycle_count; }
+    // Calls callback at the first instruction boundary at or after cycle
+    // when; returns an id for cancel_event()
+    U32 schedule(U64 when, EventCallback callback, void* context);
+    bool cancel_event(U32 id);
+    // IRQ is level triggered, one line per source (0-31); NMI is an edge
+    void set_irq(bool level, int source = 0);
+    void trigger_nmi();
+
+    // Stop conditions for run_until(). Breakpoints and watchpoints trap just
+    // the pages they are on through the page table; stop opcodes are looked
+    // at before every instruction, but only while some are set. Watchpoints
+    // see every bus access, instruction fetches included.
+    void set_breakpoint(U16 pc, bool set);
+    void set_watchpoint(U16 address, U8 kinds); // WATCH_READ|WATCH_WRITE
+    void stop_on_opcode(U8 opcode, bool stop);
+    void stop_on_brk(bool stop);
+    void clear_stops();
+
+    // Registers plus a copy-on-write snapshot of memory, see Memory::snapshot
+    void snapshot();
+    void restore();
+
+    // Predecoded basic blocks, see block_cache.cpp
+    void enable_block_cache(bool enable);
+    void flush_block_cache();
+    BlockCacheStats block_cache_stats();
+
+    // x86-64 translation of hot blocks, see jit.cpp
+    void enable_jit(bool enable);
+    JitStats jit_stats();
+
+    // Per opcode and per PC counts. While on, execute() runs the interpreter
+    // only, block cache and JIT are bypassed; while off it costs nothing.
+    void enable_profiler(bool enable);
+    Profiler* profiler() { return profile; }
+
+    // Binary trace of every instruction, see trace.hpp. Also runs the
+    // interpreter only. stop_trace() flushes and closes the file.
+    bool start_trace(const char* path);
+    void stop_trace();
+    TraceWriter* tracer() { return trace; }
+
+    // AFL-style edge coverage into map, COVERAGE_SIZE counters: entering a
+    // block, after a jump or branch (taken or not) or an interrupt, adds one
+    // to the counter of the hashed (previous block, this block) pair. Also
+    // runs the interpreter only; nullptr turns it off. Setting a map starts
+    // a new path.
+    void set_coverage(U8* map);
 
     CPU(Memory* memory);
+    ~CPU();
 
 private:
+    template <bool STOP> int run(int num_cycles, int stop_pc);
+    template <bool STOP, bool INSTRUMENT> void execute_core();
+    void instrument(U8 opcode, U8 cycles);
+    template <bool STOP> bool fetch(U8& opcode);
+    bool fetch_slow(U8& opcode);
+    bool stop_opcode(U8 opcode);
+    bool resuming() { return PC == resume_pc && cycle_count == resume_cycle; }
+    bool block_has_stop(const Block& block);
+    static void watch_hit(void* context, U16 address, bool write);
+    void interrupt(U16 vector);
+    void end_slice();
+
+    static int host_is_little_endian();
     void set_flag(int flag, int val);
     int get_flag(int flag);
+    void set_nz(U8 value);
+    void set_nz(U8 z_value, U8 n_value);
+    void set_alu_flags(U16 result);
+    template <bool SUB> void add_with_carry(U8 m);
 
     void stack_push(U8 byte);
     U8 stack_pop();
 
+    // Fused handlers, see cpu_ops.hpp
+    template <Mode AM> U16 fetch_operand();
+    template <Mode AM> U16 address(U16 operand);
+    template <Mode AM> U8 read_operand(U16 ea);
+    template <Mode AM> void write_operand(U16 ea, U8 value);
+    template <Mnemonic M, Mode AM> void op(U16 operand);
+    void dispatch(U8 opcode);
+    template <Mnemonic M, Mode AM> static void run_op(CPU& cpu, U16 operand);
+    static void (*const fused_handlers[256])(CPU&, U16);
+
+    BlockCache* block_cache = nullptr;
+    Block* decode_block(U16 start);
+    template <bool STOP> void execute_blocks();
+    bool skip_idle_loop(const Block& block);
+
+    friend class BlockCompiler;
+    friend class LockstepEngine;
+    friend class Checkpointer;
+    Jit* jit = nullptr;
+    JitCode jit_compile(const Block& block);
+    static U8 jit_read(CPU& cpu, U16 position);
+    static void jit_write(CPU& cpu, U16 position, U8 value);
+
     // Opcodes
-    void OPCODE_ADC(U16 in); // idk
+    void OPCODE_ADC(U16 in);
     void OPCODE_AND(U16 in);
     void OPCODE_ASL(U16 in);
     void OPCODE_ASL_ACC(U16 in);
@@ -92,7 +264,7 @@ private:
     void OPCODE_ROR_ACC(U16 in);
     void OPCODE_RTI(U16 in);
     void OPCODE_RTS(U16 in);
-    void OPCODE_SBC(U16 in); // figure out
+    void OPCODE_SBC(U16 in);
     void OPCODE_SEC(U16 in);
     void OPCODE_SED(U16 in);
     void OPCODE_SEI(U16 in);
@@ -107,21 +279,48 @@ private:
     void OPCODE_TYA(U16 in);
     void OPCODE_ILLEGAL(U16 in);
 
-    const U8 BIT_7_MASK = 0x80;
-    const U8 BIT_6_MASK = 0x40;
+    static constexpr U8 BIT_7_MASK = 0x80;
+    static constexpr U8 BIT_6_MASK = 0x40;
 
-    const U16 irqVector = 0xFFFE;
-    const U16 nmiVector = 0xFFFA;
-    const U16 resetVector = 0xFFC;
+    static constexpr U16 irqVector = 0xFFFE;
+    static constexpr U16 nmiVector = 0xFFFA;
+    static constexpr U16 resetVector = 0xFFFC;
 
-    int is_little_endian = 0;
     U16 PC; // Program Counter
     U8 SP;  // Stack pointer
     U8 A;   // Accumulator
     U8 X;   // Index Register X
     U8 Y;   // Index Register Y
-    U8 processor_status = 0;
+    U8 processor_status = 0; // I, D, B and bit 5, see get_status()
+    U8 flag_c = 0;           // carry, 0 or 1
+    U8 flag_z = 1;           // Z is set when this is zero
+    U8 flag_v = 0;           // overflow, 0 or 1
+    U8 flag_n = 0;           // N is bit 7 of this
     Memory* mem;
+    U64 cycle_count = 0;
+    U64 slice_end = 0; // the running core stops here
+    // Everything the cores touch per instruction is above, in 64 bytes
+
+    Scheduler scheduler;
+    U32 irq_lines = 0;
+    bool nmi_pending = false;
+    Profiler* profile = nullptr;
+    TraceWriter* trace = nullptr;
+    U8* coverage = nullptr;
+    U16 coverage_prev = 0; // hash of the last block entered, shifted
+    int coverage_next = -1; // fall-through PC, -1 after a transfer
+    Registers saved_registers;
+
+    // Stop conditions, see run_until()
+    int until_pc = -1;         // execute_until()'s stop_pc
+    U64* break_bits = nullptr; // one bit per address, allocated on use
+    U8 opcode_stops[256] = {}; // StopReason per opcode, or STOP_NONE
+    int opcode_stop_count = 0;
+    bool watching = false;     // run_until() is running
+    int resume_pc = -1;        // where run_until() was entered, and when
+    U64 resume_cycle = 0;
+    StopInfo stop;
+    int is_little_endian = 0;
 
     // Addressing modes
     U16 implied();
@@ -139,192 +338,13 @@ private:
     U16 relative();
     U16 illegal_mode();
 
-    // OPCODE numbers taken from https://www.pagetable.com/c64ref/6502/?tab=3
-    void (CPU::*code[256])(U16){
-        &CPU::OPCODE_BRK,     &CPU::OPCODE_ORA,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ORA,
-        &CPU::OPCODE_ASL,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_PHP,
-        &CPU::OPCODE_ORA,     &CPU::OPCODE_ASL_ACC, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ORA,     &CPU::OPCODE_ASL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_BPL,     &CPU::OPCODE_ORA,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ORA,     &CPU::OPCODE_ASL,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_CLC,     &CPU::OPCODE_ORA,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ORA,
-        &CPU::OPCODE_ASL,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_JSR,
-        &CPU::OPCODE_AND,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_BIT,     &CPU::OPCODE_AND,     &CPU::OPCODE_ROL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_PLP,     &CPU::OPCODE_AND,
-        &CPU::OPCODE_ROL_ACC, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_BIT,
-        &CPU::OPCODE_AND,     &CPU::OPCODE_ROL,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_BMI,     &CPU::OPCODE_AND,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_AND,
-        &CPU::OPCODE_ROL,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_SEC,
-        &CPU::OPCODE_AND,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_AND,     &CPU::OPCODE_ROL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_RTI,     &CPU::OPCODE_EOR,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_EOR,     &CPU::OPCODE_LSR,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_PHA,     &CPU::OPCODE_EOR,     &CPU::OPCODE_LSR_ACC,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_JMP,     &CPU::OPCODE_EOR,
-        &CPU::OPCODE_LSR,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_BVC,
-        &CPU::OPCODE_EOR,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_EOR,     &CPU::OPCODE_LSR,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_CLI,     &CPU::OPCODE_EOR,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_EOR,     &CPU::OPCODE_LSR,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_RTS,     &CPU::OPCODE_ADC,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ADC,
-        &CPU::OPCODE_ROR,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_PLA,
-        &CPU::OPCODE_ADC,     &CPU::OPCODE_ROR_ACC, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_JMP,     &CPU::OPCODE_ADC,     &CPU::OPCODE_ROR,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_BVS,     &CPU::OPCODE_ADC,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ADC,     &CPU::OPCODE_ROR,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_SEI,     &CPU::OPCODE_ADC,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ADC,
-        &CPU::OPCODE_ROR,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_STA,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_STY,     &CPU::OPCODE_STA,     &CPU::OPCODE_STX,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_DEY,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_TXA,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_STY,
-        &CPU::OPCODE_STA,     &CPU::OPCODE_STX,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_BCC,     &CPU::OPCODE_STA,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_STY,     &CPU::OPCODE_STA,
-        &CPU::OPCODE_STX,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_TYA,
-        &CPU::OPCODE_STA,     &CPU::OPCODE_TXS,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_STA,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_LDY,     &CPU::OPCODE_LDA,
-        &CPU::OPCODE_LDX,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_LDY,
-        &CPU::OPCODE_LDA,     &CPU::OPCODE_LDX,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_TAY,     &CPU::OPCODE_LDA,     &CPU::OPCODE_TAX,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_LDY,     &CPU::OPCODE_LDA,
-        &CPU::OPCODE_LDX,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_BCS,
-        &CPU::OPCODE_LDA,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_LDY,     &CPU::OPCODE_LDA,     &CPU::OPCODE_LDX,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_CLV,     &CPU::OPCODE_LDA,
-        &CPU::OPCODE_TSX,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_LDY,
-        &CPU::OPCODE_LDA,     &CPU::OPCODE_LDX,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_CPY,     &CPU::OPCODE_CMP,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_CPY,     &CPU::OPCODE_CMP,
-        &CPU::OPCODE_DEC,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_INY,
-        &CPU::OPCODE_CMP,     &CPU::OPCODE_DEX,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_CPY,     &CPU::OPCODE_CMP,     &CPU::OPCODE_DEC,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_BNE,     &CPU::OPCODE_CMP,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_CMP,     &CPU::OPCODE_DEC,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_CLD,     &CPU::OPCODE_CMP,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_CMP,
-        &CPU::OPCODE_DEC,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_CPX,
-        &CPU::OPCODE_SBC,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_CPX,     &CPU::OPCODE_SBC,     &CPU::OPCODE_INC,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_INX,     &CPU::OPCODE_SBC,
-        &CPU::OPCODE_NOP,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_CPX,
-        &CPU::OPCODE_SBC,     &CPU::OPCODE_INC,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_BEQ,     &CPU::OPCODE_SBC,     &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_SBC,
-        &CPU::OPCODE_INC,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_SED,
-        &CPU::OPCODE_SBC,     &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_ILLEGAL,
-        &CPU::OPCODE_ILLEGAL, &CPU::OPCODE_SBC,     &CPU::OPCODE_INC,
-        &CPU::OPCODE_ILLEGAL};
-
-    U16(CPU::*addressing_mode[256])
-    (void) = {&CPU::implied,      &CPU::inx,          &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::zero_page,
-              &CPU::zero_page,    &CPU::illegal_mode, &CPU::implied,
-              &CPU::immediate,    &CPU::accumulator,  &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::absolute,     &CPU::absolute,
-              &CPU::illegal_mode, &CPU::relative,     &CPU::iny,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_x,       &CPU::zero_x,       &CPU::illegal_mode,
-              &CPU::implied,      &CPU::abs_y,        &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::abs_x,
-              &CPU::abs_x,        &CPU::illegal_mode, &CPU::absolute,
-              &CPU::inx,          &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_page,    &CPU::zero_page,    &CPU::zero_page,
-              &CPU::illegal_mode, &CPU::implied,      &CPU::immediate,
-              &CPU::accumulator,  &CPU::illegal_mode, &CPU::absolute,
-              &CPU::absolute,     &CPU::absolute,     &CPU::illegal_mode,
-              &CPU::relative,     &CPU::iny,          &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::zero_x,
-              &CPU::zero_x,       &CPU::illegal_mode, &CPU::implied,
-              &CPU::abs_y,        &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::abs_x,        &CPU::abs_x,
-              &CPU::illegal_mode, &CPU::implied,      &CPU::inx,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_page,    &CPU::zero_page,    &CPU::illegal_mode,
-              &CPU::implied,      &CPU::immediate,    &CPU::accumulator,
-              &CPU::illegal_mode, &CPU::absolute,     &CPU::absolute,
-              &CPU::absolute,     &CPU::illegal_mode, &CPU::relative,
-              &CPU::iny,          &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::zero_x,       &CPU::zero_x,
-              &CPU::illegal_mode, &CPU::implied,      &CPU::abs_y,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::abs_x,        &CPU::abs_x,        &CPU::illegal_mode,
-              &CPU::implied,      &CPU::inx,          &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::zero_page,
-              &CPU::zero_page,    &CPU::illegal_mode, &CPU::implied,
-              &CPU::immediate,    &CPU::accumulator,  &CPU::illegal_mode,
-              &CPU::abs_indirect, &CPU::absolute,     &CPU::absolute,
-              &CPU::illegal_mode, &CPU::relative,     &CPU::iny,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_x,       &CPU::zero_x,       &CPU::illegal_mode,
-              &CPU::implied,      &CPU::abs_y,        &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::abs_x,
-              &CPU::abs_x,        &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::inx,          &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_page,    &CPU::zero_page,    &CPU::zero_page,
-              &CPU::illegal_mode, &CPU::implied,      &CPU::illegal_mode,
-              &CPU::implied,      &CPU::illegal_mode, &CPU::absolute,
-              &CPU::absolute,     &CPU::absolute,     &CPU::illegal_mode,
-              &CPU::relative,     &CPU::iny,          &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::zero_x,       &CPU::zero_x,
-              &CPU::zero_y,       &CPU::illegal_mode, &CPU::implied,
-              &CPU::abs_y,        &CPU::implied,      &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::abs_x,        &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::immediate,    &CPU::inx,
-              &CPU::immediate,    &CPU::illegal_mode, &CPU::zero_page,
-              &CPU::zero_page,    &CPU::zero_page,    &CPU::illegal_mode,
-              &CPU::implied,      &CPU::immediate,    &CPU::implied,
-              &CPU::illegal_mode, &CPU::absolute,     &CPU::absolute,
-              &CPU::absolute,     &CPU::illegal_mode, &CPU::relative,
-              &CPU::iny,          &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_x,       &CPU::zero_x,       &CPU::zero_y,
-              &CPU::illegal_mode, &CPU::implied,      &CPU::abs_y,
-              &CPU::implied,      &CPU::illegal_mode, &CPU::abs_x,
-              &CPU::abs_x,        &CPU::abs_y,        &CPU::illegal_mode,
-              &CPU::immediate,    &CPU::inx,          &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::zero_page,    &CPU::zero_page,
-              &CPU::zero_page,    &CPU::illegal_mode, &CPU::implied,
-              &CPU::immediate,    &CPU::implied,      &CPU::illegal_mode,
-              &CPU::absolute,     &CPU::absolute,     &CPU::absolute,
-              &CPU::illegal_mode, &CPU::relative,     &CPU::iny,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_x,       &CPU::zero_x,       &CPU::illegal_mode,
-              &CPU::implied,      &CPU::abs_y,        &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::abs_x,
-              &CPU::abs_x,        &CPU::illegal_mode, &CPU::immediate,
-              &CPU::inx,          &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::zero_page,    &CPU::zero_page,    &CPU::zero_page,
-              &CPU::illegal_mode, &CPU::implied,      &CPU::immediate,
-              &CPU::implied,      &CPU::illegal_mode, &CPU::absolute,
-              &CPU::absolute,     &CPU::absolute,     &CPU::illegal_mode,
-              &CPU::relative,     &CPU::iny,          &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::illegal_mode, &CPU::zero_x,
-              &CPU::zero_x,       &CPU::illegal_mode, &CPU::implied,
-              &CPU::abs_y,        &CPU::illegal_mode, &CPU::illegal_mode,
-              &CPU::illegal_mode, &CPU::abs_x,        &CPU::abs_x,
-              &CPU::illegal_mode};
-    int cycle_number[256] = {
-        7, 6, 1, 1, 1, 3, 5, 1, 3, 2, 2, 1, 1, 4, 6, 1, 2, 5, 1, 1, 1, 4, 6, 1,
-        2, 4, 1, 1, 1, 4, 7, 1, 6, 6, 1, 1, 3, 3, 5, 1, 4, 2, 2, 1, 4, 4, 6, 1,
-        2, 5, 1, 1, 1, 4, 6, 1, 2, 4, 1, 1, 1, 4, 7, 1, 6, 6, 1, 1, 1, 3, 5, 1,
-        3, 2, 2, 1, 3, 4, 6, 1, 2, 5, 1, 1, 1, 4, 6, 1, 2, 4, 1, 1, 1, 4, 7, 1,
-        6, 6, 1, 1, 1, 3, 5, 1, 4, 2, 2, 1, 5, 4, 6, 1, 2, 5, 1, 1, 1, 4, 6, 1,
-        2, 4, 1, 1, 1, 4, 7, 1, 1, 6, 1, 1, 3, 3, 3, 1, 2, 1, 2, 1, 4, 4, 4, 1,
-        2, 6, 1, 1, 4, 4, 4, 1, 2, 5, 2, 1, 1, 5, 1, 1, 2, 6, 2, 1, 3, 3, 3, 1,
-        2, 2, 2, 1, 4, 4, 4, 1, 2, 5, 1, 1, 4, 4, 4, 1, 2, 4, 2, 1, 4, 4, 4, 1,
-        2, 6, 1, 1, 3, 3, 5, 1, 2, 2, 2, 1, 4, 4, 6, 1, 2, 5, 1, 1, 1, 4, 6, 1,
-        2, 4, 1, 1, 1, 4, 7, 1, 2, 6, 1, 1, 3, 3, 5, 1, 2, 2, 2, 1, 4, 4, 6, 1,
-        2, 5, 1, 1, 1, 4, 6, 1, 2, 4, 1, 1, 1, 4, 7, 1};
+    // The reference implementation of every opcode, run by the table core
+    // and checked against the fused handlers by verify_opcodes(). Cycles
+    // and lengths are in opcode_info.
+    struct ReferenceOp
+    {
+        void (CPU::*execute)(U16);
+        U16 (CPU::*address)();
+    };
+    static const ReferenceOp reference_ops[256];
 };
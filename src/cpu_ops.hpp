@@ -0,0 +1,377 @@
+#pragma once
+#include "alu.hpp"
+#include "block_cache.hpp"
+#include "cpu.hpp"
+
+// Fused opcode handlers. op<M, AM> is instantiated once per OPCODE_LIST entry,
+// so each opcode gets its addressing mode and operation compiled into a
+// single handler. They reproduce the OPCODE_* handlers exactly, which
+// verify_step() checks.
+
+inline U8 CPU::read_byte(U16 position) { return mem->read(position); }
+
+inline void CPU::write_byte(U16 position, U8 value)
+{
+    mem->write(position, value);
+}
+
+inline U16 CPU::read_word(U16 position)
+{
+    U8 first_byte = read_byte(position);
+    U8 second_byte = read_byte(position + 1);
+    if (is_little_endian)
+        return (first_byte | (second_byte << 8));
+    return (second_byte | (first_byte << 8));
+}
+
+// Flags are kept lazily: C and V as 0/1 bytes, N and Z as the last result
+// they were taken from. processor_status only holds I, D, B and bit 5, and
+// get_status() assembles the full P register when something needs it.
+inline void CPU::set_flag(int flag, int val)
+{
+    switch (flag)
+    {
+    case CARRY_FLAG:
+        flag_c = val != 0;
+        break;
+    case ZERO_FLAG:
+        flag_z = !val;
+        break;
+    case OVERFLOW_FLAG:
+        flag_v = val != 0;
+        break;
+    case NEGATIVE_FLAG:
+        flag_n = val ? BIT_7_MASK : 0;
+        break;
+    default:
+        if (val)
+            processor_status |= (1 << flag);
+        else
+            processor_status &= ~(1 << flag);
+    }
+}
+
+inline int CPU::get_flag(int flag)
+{
+    switch (flag)
+    {
+    case CARRY_FLAG:
+        return flag_c;
+    case ZERO_FLAG:
+        return !flag_z;
+    case OVERFLOW_FLAG:
+        return flag_v;
+    case NEGATIVE_FLAG:
+        return flag_n >> 7;
+    default:
+        return ((processor_status & (1 << flag)) != 0);
+    }
+}
+
+inline void CPU::set_nz(U8 value)
+{
+    flag_z = value;
+    flag_n = value;
+}
+
+inline void CPU::set_nz(U8 z_value, U8 n_value)
+{
+    flag_z = z_value;
+    flag_n = n_value;
+}
+
+// C, V, N and Z from a packed result of alu.hpp
+inline void CPU::set_alu_flags(U16 result)
+{
+    flag_c = (result & ALU_C) != 0;
+    flag_v = (result & ALU_V) != 0;
+    flag_n = (result & ALU_N) >> 3;
+    flag_z = !(result & ALU_Z);
+}
+
+// ADC, or SBC with SUB. Decimal mode is one table load, so BCD runs about as
+// fast as binary.
+template <bool SUB> inline void CPU::add_with_carry(U8 m)
+{
+    U16 r;
+    if (processor_status & (1 << DECIMAL_MODE))
+        r = SUB ? alu_tables.sub_decimal[flag_c][A][m]
+                : alu_tables.add_decimal[flag_c][A][m];
+    else
+        r = SUB ? alu_sub(A, m, flag_c) : alu_add(A, m, flag_c);
+    A = r;
+    set_alu_flags(r);
+}
+
+// Opcode fetch for the cores, false to stop before the instruction at PC.
+// Pages holding breakpoints have no read_map entry, so elsewhere this costs
+// what read_byte(PC++) does. With STOP, stop opcodes are checked as well.
+template <bool STOP> inline bool CPU::fetch(U8& opcode)
+{
+    U8* page = mem->read_map[PC >> 8];
+    if (page) [[likely]]
+        opcode = page[PC & 0xFF];
+    else if (!fetch_slow(opcode))
+        return false;
+    if (STOP && stop_opcode(opcode))
+        return false;
+    PC++;
+    return true;
+}
+
+inline bool CPU::stop_opcode(U8 opcode)
+{
+    if (!opcode_stops[opcode] || resuming())
+        return false;
+    stop.reason = (StopReason)opcode_stops[opcode];
+    stop.address = PC;
+    return true;
+}
+
+template <Mode AM> inline U16 CPU::fetch_operand()
+{
+    if constexpr (AM == Mode::implied || AM == Mode::accumulator ||
+                  AM == Mode::illegal_mode)
+        return 0;
+    else if constexpr (AM == Mode::absolute || AM == Mode::abs_x ||
+                       AM == Mode::abs_y || AM == Mode::abs_indirect)
+    {
+        U16 operand = read_word(PC);
+        PC += 2;
+        return operand;
+    }
+    else
+        return read_byte(PC++);
+}
+
+template <Mode AM> inline U16 CPU::address(U16 operand)
+{
+    if constexpr (AM == Mode::zero_x)
+        return (operand + X) & 0xFF;
+    else if constexpr (AM == Mode::zero_y)
+        return (operand + Y) & 0xFF;
+    else if constexpr (AM == Mode::abs_x)
+        return operand + X;
+    else if constexpr (AM == Mode::abs_y)
+        return operand + Y;
+    else if constexpr (AM == Mode::inx)
+    {
+        U16 r = (operand + X) & 0xFF;
+        return (read_byte(r + 1) << 8) + read_byte(r);
+    }
+    else if constexpr (AM == Mode::iny)
+    {
+        U16 r = (operand + 1) & 0xFF;
+        return (read_byte(r + 1) << 8) + read_byte(r) + Y;
+    }
+    else if constexpr (AM == Mode::abs_indirect)
+    {
+        U16 MSB = read_word(operand + 1);
+        return (MSB << 8) + operand;
+    }
+    else if constexpr (AM == Mode::relative)
+    {
+        U16 r = operand;
+        if (r & BIT_7_MASK)
+            r |= 0xFF00;
+        return r + PC;
+    }
+    else if constexpr (AM == Mode::implied || AM == Mode::accumulator ||
+                       AM == Mode::illegal_mode)
+        return 0;
+    else // immediate carries the value, zero page and absolute the address
+        return operand;
+}
+
+template <Mode AM> inline U8 CPU::read_operand(U16 ea)
+{
+    if constexpr (AM == Mode::accumulator)
+        return A;
+    else if constexpr (AM == Mode::immediate)
+        return ea;
+    else
+        return read_byte(ea);
+}
+
+template <Mode AM> inline void CPU::write_operand(U16 ea, U8 value)
+{
+    if constexpr (AM == Mode::accumulator)
+        A = value;
+    else
+        write_byte(ea, value);
+}
+
+template <Mnemonic M, Mode AM> inline void CPU::op(U16 operand)
+{
+    using enum Mnemonic;
+    U16 ea = address<AM>(operand);
+
+    // Loads, stores and transfers
+    if constexpr (M == LDA || M == LDX || M == LDY)
+    {
+        U8 m = read_operand<AM>(ea);
+        set_nz(m);
+        (M == LDA ? A : M == LDX ? X : Y) = m;
+    }
+    else if constexpr (M == STA)
+        write_byte(ea, A);
+    else if constexpr (M == STX)
+        write_byte(ea, X);
+    else if constexpr (M == STY)
+        write_byte(ea, Y);
+    else if constexpr (M == TAX || M == TAY || M == TSX || M == TXA ||
+                       M == TXS || M == TYA)
+    {
+        // TXA and TXS take N and Z from X, like the table handlers
+        U8 m = (M == TAX || M == TAY) ? A : M == TSX ? SP : M == TYA ? Y : X;
+        (M == TAX || M == TSX ? X : M == TAY ? Y : M == TXS ? SP : A) = m;
+        set_nz(m);
+    }
+
+    // Arithmetic and logic
+    else if constexpr (M == ADC || M == SBC)
+        add_with_carry<M == SBC>(read_operand<AM>(ea));
+    else if constexpr (M == AND || M == ORA || M == EOR)
+    {
+        U8 m = read_operand<AM>(ea);
+        m = M == AND ? (A & m) : M == ORA ? (A | m) : (A ^ m);
+        set_nz(m);
+        A = m;
+    }
+    else if constexpr (M == CMP || M == CPX || M == CPY)
+    {
+        U8 r = M == CMP ? A : M == CPX ? X : Y;
+        U16 result = alu_sub(r, read_operand<AM>(ea), 1);
+        flag_c = (result & ALU_C) != 0;
+        set_nz(result);
+    }
+    else if constexpr (M == BIT)
+    {
+        U8 r = read_operand<AM>(ea);
+        set_flag(OVERFLOW_FLAG, r & BIT_6_MASK);
+        set_nz(A & r, r);
+    }
+
+    // Read-modify-write, the accumulator forms come from AM
+    else if constexpr (M == ASL || M == LSR || M == ROL || M == ROR ||
+                       M == INC || M == DEC)
+    {
+        U8 m = read_operand<AM>(ea);
+        U8 carry = get_flag(CARRY_FLAG);
+        if constexpr (M == ASL || M == ROL)
+        {
+            set_flag(CARRY_FLAG, m & BIT_7_MASK);
+            m = (m << 1) | (M == ROL ? carry : 0);
+        }
+        else if constexpr (M == LSR || M == ROR)
+        {
+            set_flag(CARRY_FLAG, m & 0x01);
+            m = (m >> 1) | (M == ROR && carry ? BIT_7_MASK : 0);
+        }
+        else
+            m += M == INC ? 1 : -1;
+        set_nz(m);
+        write_operand<AM>(ea, m);
+    }
+    else if constexpr (M == INX || M == DEX)
+    {
+        X += M == INX ? 1 : -1;
+        set_nz(X);
+    }
+    else if constexpr (M == INY || M == DEY)
+    {
+        Y += M == INY ? 1 : -1;
+        set_nz(Y);
+    }
+
+    // Branches and jumps
+    else if constexpr (M == BCC || M == BCS)
+    {
+        if (get_flag(CARRY_FLAG) == (M == BCS))
+            PC = ea;
+    }
+    else if constexpr (M == BNE || M == BEQ)
+    {
+        if (get_flag(ZERO_FLAG) == (M == BEQ))
+            PC = ea;
+    }
+    else if constexpr (M == BPL || M == BMI)
+    {
+        if (get_flag(NEGATIVE_FLAG) == (M == BMI))
+            PC = ea;
+    }
+    else if constexpr (M == BVC || M == BVS)
+    {
+        if (get_flag(OVERFLOW_FLAG) == (M == BVS))
+            PC = ea;
+    }
+    else if constexpr (M == JMP)
+        PC = ea;
+    else if constexpr (M == JSR)
+    {
+        PC--;
+        stack_push((PC >> 8) & 0xFF);
+        stack_push(PC & 0xFF);
+        PC = ea;
+    }
+    else if constexpr (M == RTS)
+    {
+        U8 l = stack_pop();
+        U8 h = stack_pop();
+        PC = ((h << 8) | l) + 1;
+    }
+    else if constexpr (M == BRK)
+    {
+        PC++;
+        set_flag(BREAK_COMMAND, 1);
+        stack_push((PC >> 8) & 0xFF);
+        stack_push(PC & 0xFF);
+        stack_push(get_status());
+        PC = read_word(irqVector);
+    }
+    else if constexpr (M == RTI)
+    {
+        set_status(stack_pop() | (1 << BREAK_COMMAND));
+        U8 l = stack_pop();
+        U8 h = stack_pop();
+        PC = ((h << 8) | l);
+    }
+
+    // Stack and status
+    else if constexpr (M == PHA)
+        stack_push(A);
+    else if constexpr (M == PHP)
+        stack_push(get_status());
+    else if constexpr (M == PLA)
+    {
+        A = stack_pop();
+        set_nz(A);
+    }
+    else if constexpr (M == PLP)
+        set_status(stack_pop());
+    else if constexpr (M == CLC || M == SEC)
+        set_flag(CARRY_FLAG, M == SEC);
+    else if constexpr (M == CLD || M == SED)
+        set_flag(DECIMAL_MODE, M == SED);
+    else if constexpr (M == CLI || M == SEI)
+        set_flag(INTERRUPT_DISABLE, M == SEI);
+    else if constexpr (M == CLV)
+        set_flag(OVERFLOW_FLAG, 0);
+    else if constexpr (M == NOP)
+        return;
+    else
+        OPCODE_ILLEGAL(ea);
+}
+
+inline void CPU::dispatch(U8 opcode)
+{
+    switch (opcode)
+    {
+#define X(code, mnemonic, mode, cycles)                                        \
+    case 0x##code:                                                             \
+        op<Mnemonic::mnemonic, Mode::mode>(fetch_operand<Mode::mode>());       \
+        break;
+        OPCODE_LIST(X)
+#undef X
+    }
+}
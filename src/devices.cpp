@@ -0,0 +1,82 @@
+#include "devices.hpp"
+
+U8 IntervalTimer::read(U16 address)
+{
+    // An expiry is only handled at the next instruction boundary, so a read
+    // in the same instruction can come after due
+    U64 left = period();
+    if (control & RUNNING)
+        left = now() < due ? due - now() : 0;
+    switch (address & 3)
+    {
+    case 0:
+        return left & 0xFF;
+    case 1:
+        return (left >> 8) & 0xFF;
+    case 2:
+        return control;
+    default:
+        return status;
+    }
+}
+
+PeripheralTask IntervalTimer::run()
+{
+    for (;;)
+    {
+        BusWrite w =
+            co_await next_write(control & RUNNING ? due : Scheduler::NEVER);
+        if (w.timed_out)
+        {
+            expiries++;
+            status |= EXPIRED;
+            if (control & IRQ_ENABLE)
+                cpu->set_irq(true, irq_source);
+            due += period();
+            continue;
+        }
+        switch (w.address & 3)
+        {
+        case 0:
+            period_latch = (period_latch & 0xFF00) | w.value;
+            break;
+        case 1:
+            period_latch = (period_latch & 0x00FF) | w.value << 8;
+            restart();
+            break;
+        case 2:
+            if (w.value & RUNNING && !(control & RUNNING))
+                restart();
+            control = w.value;
+            if (!(control & IRQ_ENABLE))
+                cpu->set_irq(false, irq_source);
+            break;
+        case 3:
+            status = 0;
+            cpu->set_irq(false, irq_source);
+            break;
+        }
+    }
+}
+
+U8 Uart::read(U16 address)
+{
+    if (address & 1)
+        return busy || queued_writes() ? 0 : READY;
+    return 0;
+}
+
+PeripheralTask Uart::run()
+{
+    for (;;)
+    {
+        BusWrite w = co_await next_write();
+        if (w.address & 1)
+            continue;
+        busy = true;
+        co_await delay(cycles_per_byte);
+        fputc(w.value, out);
+        bytes_sent++;
+        busy = false;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "peripheral.hpp"
+#include <cstdio>
+
+// Interval timer, registers mirrored every 4 bytes across its pages:
+//   0, 1  period low/high; reads give the cycles left in the interval.
+//         Writing the high byte restarts the interval.
+//   2     control: bit 0 running, bit 1 IRQ on expiry. Starting restarts.
+//   3     status: bit 7 expired; any write clears it and the IRQ.
+// A period of 0 counts 65536 cycles. Expiries are cycle exact: each interval
+// starts where the last one was due, not where it was noticed.
+class IntervalTimer : public Peripheral
+{
+public:
+    enum
+    {
+        RUNNING = 1 << 0,
+        IRQ_ENABLE = 1 << 1,
+        EXPIRED = 1 << 7,
+    };
+
+    IntervalTimer(int irq_source = 0) : irq_source(irq_source) {}
+    U8 read(U16 address) override;
+    U64 expiries = 0;
+
+protected:
+    PeripheralTask run() override;
+
+private:
+    int irq_source;
+    U16 period_latch = 0;
+    U8 control = 0;
+    U8 status = 0;
+    U64 due = 0; // cycle the running interval ends on
+
+    U64 period() { return period_latch ? period_latch : 0x10000; }
+    void restart() { due = now() + period(); }
+};
+
+// Transmit-only serial port writing to a host file, registers mirrored
+// every 2 bytes across its pages:
+//   0  data: a write sends the byte, cycles_per_byte later
+//   1  status: bit 7 ready (nothing being sent or queued)
+// Bytes written while busy wait in the Peripheral write queue.
+class Uart : public Peripheral
+{
+public:
+    enum
+    {
+        READY = 1 << 7,
+    };
+
+    // 9600 baud, 10 bits a byte, at 1 MHz
+    static const int DEFAULT_CYCLES_PER_BYTE = 1042;
+
+    // out stays the caller's to close
+    Uart(FILE* out, int cycles_per_byte = DEFAULT_CYCLES_PER_BYTE)
+        : out(out), cycles_per_byte(cycles_per_byte)
+    {
+    }
+    U8 read(U16 address) override;
+    U64 bytes_sent = 0;
+
+protected:
+    PeripheralTask run() override;
+
+private:
+    FILE* out;
+    int cycles_per_byte;
+    bool busy = false;
+};
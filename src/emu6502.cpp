@@ -0,0 +1,208 @@
+#include "emu6502.h"
+#include "checkpoint.hpp"
+#include "cpu.hpp"
+#include "loader.hpp"
+#include "rom.hpp"
+#include <new>
+
+static_assert((int)EMU6502_IMAGE_INES == (int)IMAGE_INES, "image formats match");
+static_assert((int)EMU6502_TOO_BIG == (int)LOAD_TOO_BIG, "load errors match");
+static_assert((int)EMU6502_STOP_WRITE_WATCH == (int)STOP_WRITE_WATCH,
+              "stop reasons match");
+static_assert((int)EMU6502_WATCH_WRITE == (int)WATCH_WRITE, "watch kinds match");
+
+struct emu6502
+{
+    Memory mem;
+    CPU cpu;
+    Checkpointer checkpoints;
+
+    // Arena spaces are always 64K, so smaller machines take just their RAM
+    // from the heap
+    emu6502(U32 size)
+        : mem(size, size == 0x10000 ? &MemoryArena::shared() : nullptr),
+          cpu(&mem), checkpoints(&cpu)
+    {
+        cpu.report_illegal = false;
+    }
+};
+
+emu6502* emu6502_create(size_t memory_size)
+{
+    U32 size = memory_size == 0 || memory_size > 0x10000 ? 0x10000 : memory_size;
+    try
+    {
+        return new emu6502(size);
+    }
+    catch (std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void emu6502_destroy(emu6502* machine) { delete machine; }
+
+int emu6502_load(emu6502* machine, const void* data, size_t size, int format,
+                 uint16_t address)
+{
+    Loader loader(&machine->mem);
+    return loader.load_data((const U8*)data, size, (ImageFormat)format,
+                            address);
+}
+
+int emu6502_load_file(emu6502* machine, const char* path, int format,
+                      uint16_t address)
+{
+    Loader loader(&machine->mem);
+    return loader.load_file(path, (ImageFormat)format, address);
+}
+
+const char* emu6502_error_string(int error)
+{
+    return Loader::error_string((LoadError)error);
+}
+
+struct emu6502_rom
+{
+    SharedRom rom;
+};
+
+static emu6502_rom* rom_result(emu6502_rom* rom, LoadError result, int* error)
+{
+    if (error)
+        *error = result;
+    if (result == LOAD_OK)
+        return rom;
+    delete rom;
+    return nullptr;
+}
+
+emu6502_rom* emu6502_rom_load(const void* data, size_t size, int* error)
+{
+    emu6502_rom* rom = new emu6502_rom();
+    return rom_result(rom, rom->rom.load_data((const U8*)data, size), error);
+}
+
+emu6502_rom* emu6502_rom_load_file(const char* path, int* error)
+{
+    emu6502_rom* rom = new emu6502_rom();
+    return rom_result(rom, rom->rom.load_file(path), error);
+}
+
+void emu6502_rom_destroy(emu6502_rom* rom) { delete rom; }
+
+int emu6502_map_rom(emu6502* machine, const emu6502_rom* rom,
+                    uint16_t address)
+{
+    return machine->mem.map_rom(address >> 8, rom->rom) ? LOAD_OK
+                                                        : LOAD_TOO_BIG;
+}
+
+void emu6502_reset(emu6502* machine) { machine->cpu.reset_to_vector(); }
+
+int emu6502_run(emu6502* machine, int cycles)
+{
+    return machine->cpu.execute(cycles);
+}
+
+uint64_t emu6502_cycles(emu6502* machine) { return machine->cpu.cycles(); }
+
+void emu6502_get_registers(emu6502* machine, emu6502_registers* registers)
+{
+    Registers r = machine->cpu.get_registers();
+    *registers = {r.PC, r.A, r.X, r.Y, r.SP, r.P};
+}
+
+void emu6502_set_registers(emu6502* machine,
+                           const emu6502_registers* registers)
+{
+    machine->cpu.set_registers({registers->pc, registers->a, registers->x,
+                                registers->y, registers->sp, registers->p});
+}
+
+uint8_t emu6502_read(emu6502* machine, uint16_t address)
+{
+    return machine->mem.read(address);
+}
+
+void emu6502_write(emu6502* machine, uint16_t address, uint8_t value)
+{
+    machine->mem.write(address, value);
+}
+
+void emu6502_set_irq(emu6502* machine, int level, int source)
+{
+    machine->cpu.set_irq(level, source);
+}
+
+void emu6502_nmi(emu6502* machine) { machine->cpu.trigger_nmi(); }
+
+void emu6502_set_option(emu6502* machine, int option, int value)
+{
+    CPU& cpu = machine->cpu;
+    switch (option)
+    {
+    case EMU6502_BLOCK_CACHE:
+        cpu.enable_block_cache(value);
+        break;
+    case EMU6502_JIT:
+        cpu.enable_jit(value);
+        break;
+    case EMU6502_SKIP_IDLE:
+        cpu.skip_idle = value;
+        break;
+    case EMU6502_REPORT_ILLEGAL:
+        cpu.report_illegal = value;
+        break;
+    }
+}
+
+void emu6502_set_breakpoint(emu6502* machine, uint16_t pc, int set)
+{
+    machine->cpu.set_breakpoint(pc, set);
+}
+
+void emu6502_set_watchpoint(emu6502* machine, uint16_t address, int kinds)
+{
+    machine->cpu.set_watchpoint(address, kinds);
+}
+
+void emu6502_stop_on_opcode(emu6502* machine, uint8_t opcode, int stop)
+{
+    machine->cpu.stop_on_opcode(opcode, stop);
+}
+
+void emu6502_clear_stops(emu6502* machine) { machine->cpu.clear_stops(); }
+
+int emu6502_run_until(emu6502* machine, int cycles, emu6502_stop* stop)
+{
+    StopInfo info = machine->cpu.run_until(cycles);
+    if (stop)
+        *stop = {info.reason, info.address, info.cycles};
+    return info.reason;
+}
+
+int emu6502_checkpoint_start(emu6502* machine, const char* base_path,
+                             const char* delta_path)
+{
+    return machine->checkpoints.start(base_path, delta_path);
+}
+
+int emu6502_checkpoint_load(emu6502* machine, const char* base_path,
+                            const char* delta_path)
+{
+    return machine->checkpoints.load(base_path, delta_path);
+}
+
+int emu6502_checkpoint_resume(emu6502* machine, const char* delta_path)
+{
+    return machine->checkpoints.resume(delta_path);
+}
+
+void emu6502_checkpoint(emu6502* machine) { machine->checkpoints.checkpoint(); }
+
+int emu6502_checkpoint_finish(emu6502* machine)
+{
+    machine->checkpoints.finish();
+    return !machine->checkpoints.failed();
+}
@@ -0,0 +1,158 @@
+/* C interface to the emulator, for embedding. A machine is one CPU with
+ * its own memory; separate machines can run on separate threads. Nothing
+ * here prints, and only the _file and checkpoint functions touch files. */
+#ifndef EMU6502_H
+#define EMU6502_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct emu6502 emu6502;
+typedef struct emu6502_rom emu6502_rom;
+
+typedef struct
+{
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+} emu6502_registers;
+
+/* Image formats and load errors, as in loader.hpp */
+enum
+{
+    EMU6502_IMAGE_AUTO,
+    EMU6502_IMAGE_RAW,
+    EMU6502_IMAGE_PRG,
+    EMU6502_IMAGE_HEX,
+    EMU6502_IMAGE_INES
+};
+
+enum
+{
+    EMU6502_OK,
+    EMU6502_OPEN_FAILED,
+    EMU6502_READ_FAILED,
+    EMU6502_BAD_FORMAT,
+    EMU6502_BAD_CHECKSUM,
+    EMU6502_TOO_BIG
+};
+
+/* Options for emu6502_set_option() */
+enum
+{
+    EMU6502_BLOCK_CACHE, /* predecoded blocks, off by default */
+    EMU6502_JIT,         /* x86-64 translation, implies the block cache */
+    EMU6502_SKIP_IDLE,   /* fast-forward idle loops, on by default */
+    EMU6502_REPORT_ILLEGAL /* print illegal opcodes, off by default */
+};
+
+/* memory_size is the RAM in bytes from address 0, 0 for the full 64K; ROM
+ * can be mapped above it. Full machines come from a shared hugepage arena.
+ * Returns NULL when out of memory. The machine starts reset with PC at
+ * 0x0600 and zeroed RAM. */
+emu6502* emu6502_create(size_t memory_size);
+void emu6502_destroy(emu6502* machine);
+
+int emu6502_load(emu6502* machine, const void* data, size_t size, int format,
+                 uint16_t address);
+int emu6502_load_file(emu6502* machine, const char* path, int format,
+                      uint16_t address);
+const char* emu6502_error_string(int error);
+
+/* Read-only images that any number of machines map without copying, e.g.
+ * shared firmware. A ROM must outlive the machines mapping it. Files are
+ * mapped, data is copied once. error may be NULL. */
+emu6502_rom* emu6502_rom_load(const void* data, size_t size, int* error);
+emu6502_rom* emu6502_rom_load_file(const char* path, int* error);
+void emu6502_rom_destroy(emu6502_rom* rom);
+/* Maps rom at address, which is rounded down to a page; writes there are
+ * ignored. Returns EMU6502_TOO_BIG if it runs past 0xFFFF. */
+int emu6502_map_rom(emu6502* machine, const emu6502_rom* rom,
+                    uint16_t address);
+
+/* Registers to their reset state, PC from the reset vector */
+void emu6502_reset(emu6502* machine);
+/* Runs at least cycles cycles, stopping at an instruction boundary;
+ * returns the cycles run */
+int emu6502_run(emu6502* machine, int cycles);
+uint64_t emu6502_cycles(emu6502* machine);
+
+void emu6502_get_registers(emu6502* machine, emu6502_registers* registers);
+void emu6502_set_registers(emu6502* machine,
+                           const emu6502_registers* registers);
+
+/* Bus accesses: ROM ignores writes and unmapped addresses read 0 */
+uint8_t emu6502_read(emu6502* machine, uint16_t address);
+void emu6502_write(emu6502* machine, uint16_t address, uint8_t value);
+
+/* IRQ is a level per source (0-31), NMI an edge */
+void emu6502_set_irq(emu6502* machine, int level, int source);
+void emu6502_nmi(emu6502* machine);
+
+void emu6502_set_option(emu6502* machine, int option, int value);
+
+/* Why emu6502_run_until() returned, as in cpu.hpp. Breakpoints and opcode
+ * stops leave PC on the instruction, not yet run; watchpoints stop after
+ * the instruction that made the access. */
+enum
+{
+    EMU6502_STOP_NONE,
+    EMU6502_STOP_CYCLES,
+    EMU6502_STOP_BREAKPOINT,
+    EMU6502_STOP_BRK,
+    EMU6502_STOP_OPCODE,
+    EMU6502_STOP_READ_WATCH,
+    EMU6502_STOP_WRITE_WATCH
+};
+
+/* Kinds of access for emu6502_set_watchpoint(), 0 to clear */
+enum
+{
+    EMU6502_WATCH_READ = 1,
+    EMU6502_WATCH_WRITE = 2
+};
+
+typedef struct
+{
+    int reason;
+    uint16_t address; /* PC stopped at, or the watched address */
+    int cycles;       /* cycles run */
+} emu6502_stop;
+
+void emu6502_set_breakpoint(emu6502* machine, uint16_t pc, int set);
+void emu6502_set_watchpoint(emu6502* machine, uint16_t address, int kinds);
+/* Opcode 0x00 stops with EMU6502_STOP_BRK */
+void emu6502_stop_on_opcode(emu6502* machine, uint8_t opcode, int stop);
+void emu6502_clear_stops(emu6502* machine);
+/* Like emu6502_run() but also stops on the conditions above. The first
+ * instruction is not checked, so a run goes on past the last stop. Returns
+ * the reason; stop may be NULL. */
+int emu6502_run_until(emu6502* machine, int cycles, emu6502_stop* stop);
+
+/* Checkpoints, see checkpoint.hpp: a full base file, then a delta file of
+ * the registers and written pages at each emu6502_checkpoint(), which
+ * copies them and leaves the writing to a background thread. Devices and
+ * pending events are not saved. start and resume return 0 if the files
+ * can't be opened; finish waits for the writes and returns 0 if any
+ * failed. load takes the base and every complete delta record and returns
+ * a load error; emu6502_checkpoint_resume() then appends to the delta. */
+int emu6502_checkpoint_start(emu6502* machine, const char* base_path,
+                             const char* delta_path);
+int emu6502_checkpoint_load(emu6502* machine, const char* base_path,
+                            const char* delta_path);
+int emu6502_checkpoint_resume(emu6502* machine, const char* delta_path);
+void emu6502_checkpoint(emu6502* machine);
+int emu6502_checkpoint_finish(emu6502* machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#include "fuzz.hpp"
+#include <algorithm>
+#include <cstring>
+
+FuzzHarness::FuzzHarness(U8* coverage)
+    : mem(0x10000, &MemoryArena::shared()), processor(&mem)
+{
+    owns_coverage = !coverage;
+    this->coverage = coverage ? coverage : new U8[COVERAGE_SIZE]();
+    processor.report_illegal = false;
+    processor.stop_on_brk(true);
+}
+
+FuzzHarness::~FuzzHarness()
+{
+    if (owns_coverage)
+        delete[] coverage;
+}
+
+void FuzzHarness::arm() { processor.snapshot(); }
+
+StopInfo FuzzHarness::run(const U8* data, size_t size)
+{
+    processor.restore();
+    // Cut to the end of memory too, where Memory::load() would refuse it all
+    U16 length = std::min<size_t>(
+        {size, input_size, mem.backing_size - input_address});
+    if (length)
+        mem.load(input_address, data, length);
+    if (length_address >= 0)
+    {
+        U8 word[2] = {(U8)length, (U8)(length >> 8)};
+        mem.load(length_address, word, 2);
+    }
+    memset(coverage, 0, COVERAGE_SIZE);
+    processor.set_coverage(coverage);
+    runs++;
+    return processor.run_until(max_cycles);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "cpu.hpp"
+
+// In-process fuzzing of 6502 code. Set the machine up through memory() and
+// cpu() (program, registers, stop conditions), then arm() it; every run()
+// starts from that state again. Resetting is a copy-on-write restore, so it
+// costs the pages the last input touched, not the whole memory.
+class FuzzHarness
+{
+public:
+    U16 input_address = 0x0200; // where the input goes
+    U16 input_size = 0x100;     // longer inputs are cut to this, and to
+                                // the end of memory
+    int length_address = -1; // input length as a little-endian word, or -1
+    int max_cycles = 100000; // per input
+
+    // coverage is COVERAGE_SIZE counters, cleared by every run(); without
+    // one the harness uses its own
+    FuzzHarness(U8* coverage = nullptr);
+    ~FuzzHarness();
+
+    Memory& memory() { return mem; }
+    CPU& cpu() { return processor; }
+    const U8* edges() { return coverage; }
+    U64 execs() { return runs; }
+
+    // Takes the state inputs start from. A BRK ends a run; stops are set
+    // through cpu() as for run_until().
+    void arm();
+    // Restores the armed state, injects data and runs to a stop condition
+    // or max_cycles, counting edges into the coverage map
+    StopInfo run(const U8* data, size_t size);
+
+private:
+    Memory mem;
+    CPU processor;
+    U8* coverage;
+    bool owns_coverage;
+    U64 runs = 0;
+};
@@ -0,0 +1,842 @@
+#include "jit.hpp"
+#include "block_cache.hpp"
+#include "cpu_ops.hpp"
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+void CPU::enable_jit(bool enable)
+{
+    if (enable && !jit)
+    {
+        enable_block_cache(true);
+        jit = new Jit();
+    }
+    else if (!enable && jit)
+    {
+        if (block_cache)
+            for (auto& entry : block_cache->blocks)
+                entry.second.native = nullptr;
+        delete jit;
+        jit = nullptr;
+    }
+}
+
+JitStats CPU::jit_stats() { return jit ? jit->stats : JitStats(); }
+
+// Called from native code for accesses the page table sends to the slow path
+U8 CPU::jit_read(CPU& cpu, U16 position) { return cpu.mem->read_slow(position); }
+
+void CPU::jit_write(CPU& cpu, U16 position, U8 value)
+{
+    cpu.mem->write_slow(position, value);
+}
+
+#ifdef JIT_X86_64
+
+Jit::Jit()
+{
+    void* p = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+        buffer = (U8*)p;
+}
+
+Jit::~Jit()
+{
+    if (buffer)
+        munmap(buffer, BUFFER_SIZE);
+}
+
+enum
+{
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15
+};
+
+// 6502 state lives in host registers for the whole block; rbx holds the
+// Memory (for its page table) and rbp the CPU. Everything is spilled around
+// helper calls.
+static const int REG_A = R12, REG_X = R13, REG_Y = R14, REG_SP = R15;
+static const int REG_Z = R8, REG_N = R9, REG_C = R10, REG_V = R11;
+static const int MEM = RBX, CPUREG = RBP;
+
+enum
+{
+    ALU_ADD = 0,
+    ALU_OR = 1,
+    ALU_AND = 4,
+    ALU_SUB = 5,
+    ALU_XOR = 6,
+    ALU_CMP = 7
+};
+
+enum
+{
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5
+};
+
+class Emitter
+{
+public:
+    std::vector<U8> code;
+
+    void byte(U8 b) { code.push_back(b); }
+    void word(U16 w)
+    {
+        byte(w);
+        byte(w >> 8);
+    }
+    void dword(U32 d)
+    {
+        for (int i = 0; i < 4; i++)
+            byte(d >> (i * 8));
+    }
+    void qword(U64 q)
+    {
+        for (int i = 0; i < 8; i++)
+            byte(q >> (i * 8));
+    }
+    void rex(bool w, int reg, int base)
+    {
+        U8 r = 0x40 | (w << 3) | ((reg >> 1) & 4) | (base >> 3);
+        if (r != 0x40)
+            byte(r);
+    }
+    void modrm(int mod, int reg, int rm)
+    {
+        byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void mov_imm(int r, U32 imm)
+    {
+        rex(0, 0, r);
+        byte(0xB8 + (r & 7));
+        dword(imm);
+    }
+    void mov_imm64(int r, U64 imm)
+    {
+        rex(1, 0, r);
+        byte(0xB8 + (r & 7));
+        qword(imm);
+    }
+    void mov(int dst, int src)
+    {
+        rex(0, src, dst);
+        byte(0x89);
+        modrm(3, src, dst);
+    }
+    void alu_imm(int op, int r, U32 imm)
+    {
+        rex(0, 0, r);
+        byte(0x81);
+        modrm(3, op, r);
+        dword(imm);
+    }
+    void alu(int op, int dst, int src)
+    {
+        rex(0, src, dst);
+        byte(op * 8 + 1);
+        modrm(3, src, dst);
+    }
+    void shift(int ext, int r, U8 count)
+    {
+        rex(0, 0, r);
+        byte(0xC1);
+        modrm(3, ext, r);
+        byte(count);
+    }
+    void shl(int r, U8 count) { shift(4, r, count); }
+    void shr(int r, U8 count) { shift(5, r, count); }
+    void test_imm(int r, U32 imm)
+    {
+        rex(0, 0, r);
+        byte(0xF7);
+        modrm(3, 0, r);
+        dword(imm);
+    }
+    void test(int a, int b)
+    {
+        rex(0, b, a);
+        byte(0x85);
+        modrm(3, b, a);
+    }
+    void zero_extend_byte(int dst, int src)
+    {
+        rex(0, dst, src);
+        byte(0x0F);
+        byte(0xB6);
+        modrm(3, dst, src);
+    }
+    void setcc_al(int cc)
+    {
+        byte(0x0F);
+        byte(0x90 + cc);
+        modrm(3, 0, RAX);
+    }
+    void cmov(int cc, int dst, int src)
+    {
+        rex(0, dst, src);
+        byte(0x0F);
+        byte(0x40 + cc);
+        modrm(3, dst, src);
+    }
+
+    // mov rdx, [rbx + rdx * 8 + disp32]: page table entry for page rdx
+    void load_page_entry(int offset)
+    {
+        byte(0x48);
+        byte(0x8B);
+        modrm(2, RDX, 4);
+        byte((3 << 6) | (RDX << 3) | MEM);
+        dword(offset);
+    }
+    // movzx dst, byte [rdx + rsi]
+    void load_page_byte(int dst)
+    {
+        rex(0, dst, 0);
+        byte(0x0F);
+        byte(0xB6);
+        modrm(0, dst, 4);
+        byte((RSI << 3) | RDX);
+    }
+    // mov byte [rdx + rsi], src
+    void store_page_byte(int src)
+    {
+        rex(0, src, 0);
+        byte(0x88);
+        modrm(0, src, 4);
+        byte((RSI << 3) | RDX);
+    }
+    // mov [rsp], eax and back: the stack slot keeps an address over calls
+    void save_eax()
+    {
+        byte(0x89);
+        byte(0x04);
+        byte(0x24);
+    }
+    void restore_eax()
+    {
+        byte(0x8B);
+        byte(0x04);
+        byte(0x24);
+    }
+    void test64(int r)
+    {
+        rex(1, r, r);
+        byte(0x85);
+        modrm(3, r, r);
+    }
+    // mov byte [rbp + disp32], src
+    void store_field(int src, int offset)
+    {
+        rex(0, src, CPUREG);
+        byte(0x88);
+        modrm(2, src, CPUREG);
+        dword(offset);
+    }
+    // movzx dst, byte [rbp + disp32]
+    void load_field(int dst, int offset)
+    {
+        rex(0, dst, CPUREG);
+        byte(0x0F);
+        byte(0xB6);
+        modrm(2, dst, CPUREG);
+        dword(offset);
+    }
+    // mov word [rbp + disp32], imm16
+    void store_field16(int offset, U16 value)
+    {
+        byte(0x66);
+        byte(0xC7);
+        modrm(2, 0, CPUREG);
+        dword(offset);
+        word(value);
+    }
+    // add/sub qword [rbp + disp32], imm32
+    void add_field64(int offset, U32 value, bool subtract = false)
+    {
+        byte(0x48);
+        byte(0x81);
+        modrm(2, subtract ? 5 : 0, CPUREG);
+        dword(offset);
+        dword(value);
+    }
+    // mov word [rbp + disp32], ax
+    void store_field16_ax(int offset)
+    {
+        byte(0x66);
+        byte(0x89);
+        modrm(2, RAX, CPUREG);
+        dword(offset);
+    }
+    // cmp byte [rax], 0
+    void cmp_rax_zero()
+    {
+        byte(0x80);
+        modrm(0, 7, RAX);
+        byte(0);
+    }
+    size_t jmp()
+    {
+        byte(0xE9);
+        dword(0);
+        return code.size() - 4;
+    }
+    size_t jcc(int cc)
+    {
+        byte(0x0F);
+        byte(0x80 + cc);
+        dword(0);
+        return code.size() - 4;
+    }
+    void patch(size_t at)
+    {
+        U32 rel = code.size() - (at + 4);
+        memcpy(&code[at], &rel, 4);
+    }
+    void push(int r)
+    {
+        rex(0, 0, r);
+        byte(0x50 + (r & 7));
+    }
+    void pop(int r)
+    {
+        rex(0, 0, r);
+        byte(0x58 + (r & 7));
+    }
+    void call(void* fn)
+    {
+        mov_imm64(RAX, (U64)fn);
+        byte(0xFF);
+        modrm(3, 2, RAX);
+    }
+};
+
+class BlockCompiler
+{
+public:
+    BlockCompiler(CPU& cpu) : cpu(cpu) {}
+
+    bool compile(const Block& block);
+    Emitter e;
+
+private:
+    CPU& cpu;
+    int cycles = 0; // cycles up to and including the current instruction
+    bool loaded = false; // the current instruction read through load()
+
+    int field(const void* p) { return (const U8*)p - (const U8*)&cpu; }
+
+    void spill();
+    void reload();
+    void epilogue();
+    void exit_block();
+    void leave_if_invalidated();
+    void set_nz(int r);
+    void effective_address(Mode mode, U16 operand);
+    void read_operand(Mode mode, U16 operand, int dst, U16 next_pc);
+    void call_cpu(void* fn);
+    void load(int dst, U16 next_pc);
+    void store(int src, U16 next_pc);
+    void helper(const DecodedOp& d, bool last);
+    void branch(int flag, int cc_taken, U16 taken, U16 not_taken);
+    bool native(const DecodedOp& d, bool last);
+};
+
+void BlockCompiler::spill()
+{
+    e.store_field(REG_A, field(&cpu.A));
+    e.store_field(REG_X, field(&cpu.X));
+    e.store_field(REG_Y, field(&cpu.Y));
+    e.store_field(REG_SP, field(&cpu.SP));
+    e.store_field(REG_Z, field(&cpu.flag_z));
+    e.store_field(REG_N, field(&cpu.flag_n));
+    e.store_field(REG_C, field(&cpu.flag_c));
+    e.store_field(REG_V, field(&cpu.flag_v));
+}
+
+void BlockCompiler::reload()
+{
+    e.load_field(REG_A, field(&cpu.A));
+    e.load_field(REG_X, field(&cpu.X));
+    e.load_field(REG_Y, field(&cpu.Y));
+    e.load_field(REG_SP, field(&cpu.SP));
+    e.load_field(REG_Z, field(&cpu.flag_z));
+    e.load_field(REG_N, field(&cpu.flag_n));
+    e.load_field(REG_C, field(&cpu.flag_c));
+    e.load_field(REG_V, field(&cpu.flag_v));
+}
+
+void BlockCompiler::epilogue()
+{
+    e.mov_imm(RAX, cycles);
+    e.byte(0x48); // add rsp, 8
+    e.byte(0x83);
+    e.byte(0xC4);
+    e.byte(0x08);
+    for (int r : {R15, R14, R13, R12, RBP, RBX})
+        e.pop(r);
+    e.byte(0xC3);
+}
+
+void BlockCompiler::exit_block()
+{
+    spill();
+    epilogue();
+}
+
+// After an instruction whose load may have gone through read_slow(): PC is
+// already past it, see load()
+void BlockCompiler::leave_if_invalidated()
+{
+    e.mov_imm64(RAX, (U64)&cpu.block_cache->invalidated);
+    e.cmp_rax_zero();
+    size_t skip = e.jcc(CC_E);
+    exit_block();
+    e.patch(skip);
+}
+
+void BlockCompiler::set_nz(int r)
+{
+    e.mov(REG_Z, r);
+    e.mov(REG_N, r);
+}
+
+// Leaves the effective address in eax
+void BlockCompiler::effective_address(Mode mode, U16 operand)
+{
+    switch (mode)
+    {
+    case Mode::zero_page:
+    case Mode::absolute:
+        e.mov_imm(RAX, operand);
+        return;
+    case Mode::zero_x:
+    case Mode::abs_x:
+        e.mov(RAX, REG_X);
+        break;
+    default:
+        e.mov(RAX, REG_Y);
+    }
+    e.alu_imm(ALU_ADD, RAX, operand);
+    bool zero_page = mode == Mode::zero_x || mode == Mode::zero_y;
+    e.alu_imm(ALU_AND, RAX, zero_page ? 0xFF : 0xFFFF);
+}
+
+void BlockCompiler::read_operand(Mode mode, U16 operand, int dst,
+                                 U16 next_pc)
+{
+    if (mode == Mode::immediate)
+        e.mov_imm(dst, operand & 0xFF);
+    else if (mode == Mode::accumulator)
+        e.mov(dst, REG_A);
+    else
+    {
+        effective_address(mode, operand);
+        load(dst, next_pc);
+    }
+}
+
+// Calls fn(cpu, esi, edx). cycle_count is brought up to date for the call
+// so devices see the same time as under the interpreter.
+void BlockCompiler::call_cpu(void* fn)
+{
+    e.add_field64(field(&cpu.cycle_count), cycles);
+    e.byte(0x48); // mov rdi, rbp
+    e.byte(0x89);
+    e.byte(0xEF);
+    e.call(fn);
+    e.add_field64(field(&cpu.cycle_count), cycles, true);
+}
+
+// Loads the byte at eax through the page table; eax is preserved. Pages
+// without a direct mapping go through Memory::read_slow(), which may raise
+// an interrupt or end the slice; compile() then leaves the block after the
+// instruction.
+void BlockCompiler::load(int dst, U16 next_pc)
+{
+    loaded = true;
+    e.mov(RDX, RAX);
+    e.shr(RDX, 8);
+    e.load_page_entry(field(cpu.mem->read_map) - field(cpu.mem));
+    e.test64(RDX);
+    size_t slow = e.jcc(CC_E);
+    e.zero_extend_byte(RSI, RAX);
+    e.load_page_byte(dst);
+    size_t done = e.jmp();
+
+    e.patch(slow);
+    spill();
+    e.store_field16(field(&cpu.PC), next_pc);
+    e.save_eax();
+    e.mov(RSI, RAX);
+    call_cpu((void*)&CPU::jit_read);
+    e.mov(RDX, RAX);
+    reload();
+    e.restore_eax();
+    e.zero_extend_byte(dst, RDX);
+    e.patch(done);
+}
+
+// Stores to eax through the page table; eax is preserved. A trapped page
+// (device, ROM, cached code) goes through Memory::write_slow(), and if that
+// dropped cached blocks the native block ends there.
+void BlockCompiler::store(int src, U16 next_pc)
+{
+    e.mov(RDX, RAX);
+    e.shr(RDX, 8);
+    e.load_page_entry(field(cpu.mem->write_map) - field(cpu.mem));
+    e.test64(RDX);
+    size_t slow = e.jcc(CC_E);
+    e.zero_extend_byte(RSI, RAX);
+    e.store_page_byte(src);
+    size_t done = e.jmp();
+
+    e.patch(slow);
+    spill();
+    e.store_field16(field(&cpu.PC), next_pc);
+    e.save_eax();
+    e.mov(RDX, src);
+    e.mov(RSI, RAX);
+    call_cpu((void*)&CPU::jit_write);
+    e.mov_imm64(RAX, (U64)&cpu.block_cache->invalidated);
+    e.cmp_rax_zero();
+    size_t skip = e.jcc(CC_E);
+    epilogue();
+    e.patch(skip);
+    reload();
+    e.restore_eax();
+    e.patch(done);
+}
+
+// Runs the instruction through its fused handler
+void BlockCompiler::helper(const DecodedOp& d, bool last)
+{
+    spill();
+    e.store_field16(field(&cpu.PC), d.next_pc);
+    e.mov_imm(RSI, d.operand);
+    call_cpu((void*)d.handler);
+    if (last)
+    {
+        epilogue();
+        return;
+    }
+    reload();
+    e.mov_imm64(RAX, (U64)&cpu.block_cache->invalidated);
+    e.cmp_rax_zero();
+    size_t skip = e.jcc(CC_E);
+    epilogue();
+    e.patch(skip);
+}
+
+void BlockCompiler::branch(int flag, int cc_taken, U16 taken, U16 not_taken)
+{
+    e.mov_imm(RAX, not_taken);
+    e.mov_imm(RCX, taken);
+    if (flag == REG_N)
+        e.test_imm(REG_N, 0x80);
+    else
+        e.test(flag, flag);
+    e.cmov(cc_taken, RAX, RCX);
+    e.store_field16_ax(field(&cpu.PC));
+}
+
+bool BlockCompiler::native(const DecodedOp& d, bool last)
+{
+    const OpcodeInfo& info = opcode_info[d.opcode];
+    Mode mode = info.mode;
+    U16 operand = d.operand;
+    switch (mode)
+    {
+    case Mode::inx:
+    case Mode::iny:
+    case Mode::abs_indirect:
+    case Mode::illegal_mode:
+        return false;
+    default:
+        break;
+    }
+    // A read watchpoint ends the run after the instruction, which the fused
+    // handler's exit check does; the page table load path can't
+    U8 page = operand >> 8;
+    bool indexed = mode == Mode::abs_x || mode == Mode::abs_y;
+    if ((mode == Mode::zero_page || mode == Mode::zero_x ||
+         mode == Mode::zero_y) &&
+        (cpu.mem->page_flags[0] & PAGE_WATCH_READ))
+        return false;
+    if ((mode == Mode::absolute || indexed) &&
+        ((cpu.mem->page_flags[page] & PAGE_WATCH_READ) ||
+         (indexed && (cpu.mem->page_flags[(U8)(page + 1)] & PAGE_WATCH_READ))))
+        return false;
+
+    using enum Mnemonic;
+    switch (info.mnemonic)
+    {
+    case LDA:
+    case LDX:
+    case LDY:
+    {
+        int r = info.mnemonic == LDA ? REG_A
+                : info.mnemonic == LDX ? REG_X
+                                       : REG_Y;
+        read_operand(mode, operand, r, d.next_pc);
+        set_nz(r);
+        return true;
+    }
+    case STA:
+    case STX:
+    case STY:
+        effective_address(mode, operand);
+        store(info.mnemonic == STA   ? REG_A
+              : info.mnemonic == STX ? REG_X
+                                     : REG_Y,
+              d.next_pc);
+        return true;
+    case TAX:
+    case TAY:
+    case TSX:
+    case TXA:
+    case TXS:
+    case TYA:
+    {
+        Mnemonic m = info.mnemonic;
+        int src = (m == TAX || m == TAY) ? REG_A
+                  : m == TSX             ? REG_SP
+                  : m == TYA             ? REG_Y
+                                         : REG_X;
+        int dst = (m == TAX || m == TSX) ? REG_X
+                  : m == TAY             ? REG_Y
+                  : m == TXS             ? REG_SP
+                                         : REG_A;
+        e.mov(dst, src);
+        set_nz(dst);
+        return true;
+    }
+    case AND:
+    case ORA:
+    case EOR:
+        read_operand(mode, operand, RCX, d.next_pc);
+        e.alu(info.mnemonic == AND   ? ALU_AND
+              : info.mnemonic == ORA ? ALU_OR
+                                     : ALU_XOR,
+              REG_A, RCX);
+        set_nz(REG_A);
+        return true;
+    case CMP:
+    case CPX:
+    case CPY:
+    {
+        int r = info.mnemonic == CMP ? REG_A
+                : info.mnemonic == CPX ? REG_X
+                                       : REG_Y;
+        read_operand(mode, operand, RCX, d.next_pc);
+        e.mov(RDX, r);
+        e.alu(ALU_CMP, RDX, RCX);
+        e.setcc_al(CC_AE);
+        e.zero_extend_byte(REG_C, RAX);
+        e.alu(ALU_SUB, RDX, RCX);
+        e.alu_imm(ALU_AND, RDX, 0xFF);
+        set_nz(RDX);
+        return true;
+    }
+    case BIT:
+        read_operand(mode, operand, RCX, d.next_pc);
+        e.mov(REG_V, RCX);
+        e.shr(REG_V, 6);
+        e.alu_imm(ALU_AND, REG_V, 1);
+        e.mov(REG_N, RCX);
+        e.mov(REG_Z, RCX);
+        e.alu(ALU_AND, REG_Z, REG_A);
+        return true;
+    case INX:
+    case DEX:
+    case INY:
+    case DEY:
+    {
+        Mnemonic m = info.mnemonic;
+        int r = (m == INX || m == DEX) ? REG_X : REG_Y;
+        e.alu_imm((m == INX || m == INY) ? ALU_ADD : ALU_SUB, r, 1);
+        e.alu_imm(ALU_AND, r, 0xFF);
+        set_nz(r);
+        return true;
+    }
+    case INC:
+    case DEC:
+    case ASL:
+    case LSR:
+    case ROL:
+    case ROR:
+    {
+        Mnemonic m = info.mnemonic;
+        int r = RCX;
+        if (mode == Mode::accumulator)
+            r = REG_A;
+        else
+        {
+            effective_address(mode, operand);
+            load(RCX, d.next_pc);
+        }
+        if (m == INC || m == DEC)
+            e.alu_imm(m == INC ? ALU_ADD : ALU_SUB, r, 1);
+        else
+        {
+            // rdx = carry out, carry in goes through the shift
+            e.mov(RDX, r);
+            if (m == ASL || m == ROL)
+            {
+                e.shr(RDX, 7);
+                e.shl(r, 1);
+                if (m == ROL)
+                    e.alu(ALU_OR, r, REG_C);
+            }
+            else
+            {
+                e.alu_imm(ALU_AND, RDX, 1);
+                e.shr(r, 1);
+                if (m == ROR)
+                {
+                    e.mov(RSI, REG_C);
+                    e.shl(RSI, 7);
+                    e.alu(ALU_OR, r, RSI);
+                }
+            }
+            e.mov(REG_C, RDX);
+        }
+        e.alu_imm(ALU_AND, r, 0xFF);
+        set_nz(r);
+        if (mode != Mode::accumulator)
+            store(RCX, d.next_pc);
+        return true;
+    }
+    case CLC:
+    case SEC:
+        e.mov_imm(REG_C, info.mnemonic == SEC);
+        return true;
+    case CLV:
+        e.mov_imm(REG_V, 0);
+        return true;
+    case NOP:
+        return true;
+    case JMP:
+        e.store_field16(field(&cpu.PC), operand);
+        return last;
+    case BCC:
+    case BCS:
+    case BNE:
+    case BEQ:
+    case BPL:
+    case BMI:
+    case BVC:
+    case BVS:
+    {
+        if (!last)
+            return false;
+        Mnemonic m = info.mnemonic;
+        U16 target = d.next_pc + (int8_t)operand;
+        int flag = (m == BCC || m == BCS)   ? REG_C
+                   : (m == BNE || m == BEQ) ? REG_Z
+                   : (m == BPL || m == BMI) ? REG_N
+                                            : REG_V;
+        // Z is set when REG_Z is zero, the others when REG_* is nonzero
+        bool taken_if_set = m == BCS || m == BEQ || m == BMI || m == BVS;
+        if (flag == REG_Z)
+            taken_if_set = !taken_if_set;
+        branch(flag, taken_if_set ? CC_NE : CC_E, target, d.next_pc);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool BlockCompiler::compile(const Block& block)
+{
+    for (int r : {RBX, RBP, R12, R13, R14, R15})
+        e.push(r);
+    e.byte(0x48); // sub rsp, 8
+    e.byte(0x83);
+    e.byte(0xEC);
+    e.byte(0x08);
+    e.byte(0x48); // mov rbp, rdi
+    e.byte(0x89);
+    e.byte(0xFD);
+    e.mov_imm64(MEM, (U64)cpu.mem);
+    reload();
+
+    for (size_t i = 0; i < block.ops.size(); i++)
+    {
+        const DecodedOp& d = block.ops[i];
+        bool last = i + 1 == block.ops.size();
+        cycles += d.cycles;
+        loaded = false;
+        if (!native(d, last))
+        {
+            helper(d, last);
+            if (last)
+                return true;
+        }
+        else if (loaded && !last)
+            leave_if_invalidated();
+    }
+    // JMP and branches have already written PC
+    const OpcodeInfo& info = opcode_info[block.ops.back().opcode];
+    if (info.mnemonic != Mnemonic::JMP && info.mode != Mode::relative)
+        e.store_field16(field(&cpu.PC), block.ops.back().next_pc);
+    exit_block();
+    return true;
+}
+
+JitCode CPU::jit_compile(const Block& block)
+{
+    if (!jit->buffer)
+        return nullptr;
+    BlockCompiler compiler(*this);
+    compiler.compile(block);
+    std::vector<U8>& code = compiler.e.code;
+    if (code.size() > Jit::BUFFER_SIZE)
+        return nullptr;
+    if (jit->used + code.size() > Jit::BUFFER_SIZE)
+    {
+        // Out of room: drop every translation and start over
+        for (auto& entry : block_cache->blocks)
+            entry.second.native = nullptr;
+        jit->used = 0;
+        jit->stats.flushes++;
+    }
+    U8* native = jit->buffer + jit->used;
+    memcpy(native, code.data(), code.size());
+    jit->used += (code.size() + 15) & ~(size_t)15;
+    jit->stats.compiled_blocks++;
+    return (JitCode)native;
+}
+
+#else
+
+Jit::Jit() {}
+
+Jit::~Jit() {}
+
+JitCode CPU::jit_compile(const Block& block) { return nullptr; }
+
+#endif
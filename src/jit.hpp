@@ -0,0 +1,18 @@
+#pragma once
+#include "cpu.hpp"
+
+// x86-64 translator for hot blocks. Code goes into one executable buffer that
+// is flushed as a whole when it fills up.
+class Jit
+{
+public:
+    static const U32 HOT_THRESHOLD = 16;
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    U8* buffer = nullptr;
+    size_t used = 0;
+    JitStats stats;
+
+    Jit();
+    ~Jit();
+};
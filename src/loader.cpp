@@ -0,0 +1,250 @@
+#include "loader.hpp"
+#include <cstring>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOADER_MMAP
+#else
+#include <cstdio>
+#endif
+
+Loader::Loader(Memory* memory) { mem = memory; }
+
+const char* Loader::error_string(LoadError error)
+{
+    switch (error)
+    {
+    case LOAD_OK:
+        return "ok";
+    case LOAD_OPEN_FAILED:
+        return "cannot open file";
+    case LOAD_READ_FAILED:
+        return "cannot read file";
+    case LOAD_BAD_FORMAT:
+        return "malformed image";
+    case LOAD_BAD_CHECKSUM:
+        return "bad checksum";
+    case LOAD_TOO_BIG:
+        return "image does not fit in memory";
+    }
+    return "unknown error";
+}
+
+static bool has_extension(const char* path, const char* ext)
+{
+    size_t n = strlen(path), e = strlen(ext);
+    if (n < e)
+        return false;
+    for (size_t i = 0; i < e; i++)
+        if ((path[n - e + i] | 0x20) != ext[i])
+            return false;
+    return true;
+}
+
+LoadError Loader::load_file(const char* path, ImageFormat format, U16 address)
+{
+    if (format == IMAGE_AUTO && has_extension(path, ".prg"))
+        format = IMAGE_PRG;
+#ifdef LOADER_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LOAD_OPEN_FAILED;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return LOAD_READ_FAILED;
+    }
+    size_t size = st.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        return load_data(nullptr, 0, format, address);
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return LOAD_READ_FAILED;
+    LoadError error = load_data((const U8*)data, size, format, address);
+    munmap(data, size);
+    return error;
+#else
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return LOAD_OPEN_FAILED;
+    std::vector<U8> data;
+    U8 chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof chunk, file)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    bool failed = ferror(file);
+    fclose(file);
+    if (failed)
+        return LOAD_READ_FAILED;
+    return load_data(data.data(), data.size(), format, address);
+#endif
+}
+
+LoadError Loader::load_data(const U8* data, size_t size, ImageFormat format,
+                            U16 address)
+{
+    if (format == IMAGE_AUTO)
+    {
+        if (size >= 4 && !memcmp(data, "NES\x1A", 4))
+            format = IMAGE_INES;
+        else if (size >= 11 && data[0] == ':')
+            format = IMAGE_HEX;
+        else
+            format = IMAGE_RAW;
+    }
+    this->format = format;
+    written = false;
+    entry = -1;
+
+    switch (format)
+    {
+    case IMAGE_PRG:
+        if (size < 2)
+            return LOAD_BAD_FORMAT;
+        return put(data[0] | (data[1] << 8), data + 2, size - 2);
+    case IMAGE_HEX:
+        return load_hex(data, size);
+    case IMAGE_INES:
+        return load_ines(data, size);
+    default:
+        return put(address, data, size);
+    }
+}
+
+// One segment; keeps first_address/last_address covering everything written
+LoadError Loader::put(U32 address, const U8* data, size_t size)
+{
+    if (!size)
+        return LOAD_OK;
+    if (address + size > mem->backing_size)
+        return LOAD_TOO_BIG;
+    mem->load(address, data, size);
+    U16 last = address + size - 1;
+    if (!written || address < first_address)
+        first_address = address;
+    if (!written || last > last_address)
+        last_address = last;
+    written = true;
+    return LOAD_OK;
+}
+
+static int hex_digit(U8 c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Records are :LLAAAATT<data>CC. Types 00 (data), 01 (end), 02/04 (upper
+// address bits, which have to stay inside 64K) and 03/05 (start address).
+LoadError Loader::load_hex(const U8* data, size_t size)
+{
+    U32 base = 0;
+    size_t i = 0;
+    U8 record[4 + 255 + 1];
+    while (i < size)
+    {
+        U8 c = data[i];
+        if (c == '\r' || c == '\n' || c == ' ' || c == '\t')
+        {
+            i++;
+            continue;
+        }
+        if (c != ':' || i + 11 > size)
+            return LOAD_BAD_FORMAT;
+        i++;
+
+        // Byte count first, then the rest of the record it implies
+        int length = 0;
+        U8 sum = 0;
+        for (int b = 0; b < 5 + length; b++)
+        {
+            if (i + 2 > size)
+                return LOAD_BAD_FORMAT;
+            int hi = hex_digit(data[i]), lo = hex_digit(data[i + 1]);
+            if (hi < 0 || lo < 0)
+                return LOAD_BAD_FORMAT;
+            i += 2;
+            record[b] = (hi << 4) | lo;
+            sum += record[b];
+            if (b == 0)
+                length = record[0];
+        }
+        if (sum)
+            return LOAD_BAD_CHECKSUM;
+
+        U16 offset = (record[1] << 8) | record[2];
+        const U8* bytes = record + 4;
+        switch (record[3])
+        {
+        case 0x00:
+        {
+            LoadError error = put(base + offset, bytes, length);
+            if (error)
+                return error;
+            break;
+        }
+        case 0x01:
+            return LOAD_OK;
+        case 0x02:
+        case 0x04:
+            if (length != 2)
+                return LOAD_BAD_FORMAT;
+            base = ((bytes[0] << 8) | bytes[1]) << (record[3] == 0x02 ? 4 : 16);
+            break;
+        case 0x03:
+        case 0x05:
+            if (length != 4)
+                return LOAD_BAD_FORMAT;
+            entry = (U16)((bytes[2] << 8) | bytes[3]);
+            break;
+        default:
+            return LOAD_BAD_FORMAT;
+        }
+    }
+    return LOAD_OK;
+}
+
+// iNES: 16 byte header, optional 512 byte trainer, then 16K PRG banks. One
+// bank is mirrored at 0x8000 and 0xC000 (NROM-128); with more, the first
+// goes at 0x8000 and the last at 0xC000, which is where mappers that fix
+// the last bank start up.
+LoadError Loader::load_ines(const U8* data, size_t size)
+{
+    const U32 BANK = 0x4000;
+    if (size < 16 || memcmp(data, "NES\x1A", 4))
+        return LOAD_BAD_FORMAT;
+    U32 banks = data[4];
+    size_t prg = 16 + ((data[6] & 0x04) ? 512 : 0);
+    if (!banks || prg + banks * BANK > size)
+        return LOAD_BAD_FORMAT;
+    if (mem->backing_size < 0x10000)
+        return LOAD_TOO_BIG;
+
+    const U8* first = data + prg;
+    const U8* last = first + (banks - 1) * BANK;
+    LoadError error = put(0x8000, first, BANK);
+    if (!error)
+        error = put(0xC000, last, BANK);
+    if (!error)
+        mem->set_rom(0x80, 0x80, true);
+    return error;
+}
+
+// Vectors are stored low byte first
+LoadError Loader::set_vector(U16 vector, U16 target)
+{
+    U8 bytes[2] = {(U8)(target & 0xFF), (U8)(target >> 8)};
+    return mem->load(vector, bytes, 2) ? LOAD_OK : LOAD_TOO_BIG;
+}
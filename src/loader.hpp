@@ -0,0 +1,55 @@
+#pragma once
+#include "memory.hpp"
+#include <cstddef>
+
+enum ImageFormat
+{
+    IMAGE_AUTO, // iNES and Intel HEX by content, PRG by a .prg extension
+    IMAGE_RAW,  // bytes as they are, at the given address
+    IMAGE_PRG,  // Commodore PRG: little-endian load address, then the bytes
+    IMAGE_HEX,  // Intel HEX records
+    IMAGE_INES, // iNES PRG ROM at 0x8000-0xFFFF, marked read-only
+};
+
+enum LoadError
+{
+    LOAD_OK,
+    LOAD_OPEN_FAILED,
+    LOAD_READ_FAILED,
+    LOAD_BAD_FORMAT,
+    LOAD_BAD_CHECKSUM,
+    LOAD_TOO_BIG, // runs past the end of memory
+};
+
+const U16 NMI_VECTOR = 0xFFFA;
+const U16 RESET_VECTOR = 0xFFFC;
+const U16 IRQ_VECTOR = 0xFFFE;
+
+// Puts program images into a Memory. Files are mapped rather than streamed
+// and every segment goes in with one Memory::load() copy. Nothing is
+// printed; failures come back as a LoadError.
+class Loader
+{
+public:
+    ImageFormat format = IMAGE_RAW; // what the last load was taken as
+    U16 first_address = 0;          // span written by the last load
+    U16 last_address = 0;
+    int entry = -1; // start address from a HEX file, -1 if none
+
+    Loader(Memory* memory);
+    LoadError load_file(const char* path, ImageFormat format = IMAGE_AUTO,
+                        U16 address = 0x0600);
+    LoadError load_data(const U8* data, size_t size,
+                        ImageFormat format = IMAGE_AUTO, U16 address = 0x0600);
+    // LOAD_TOO_BIG when the vector is past the end of a smaller memory
+    LoadError set_vector(U16 vector, U16 target);
+    static const char* error_string(LoadError error);
+
+private:
+    Memory* mem;
+    bool written;
+
+    LoadError put(U32 address, const U8* data, size_t size);
+    LoadError load_hex(const U8* data, size_t size);
+    LoadError load_ines(const U8* data, size_t size);
+};
@@ -0,0 +1,351 @@
+#include "lockstep.hpp"
+#include "cpu_ops.hpp"
+#include <algorithm>
+#include <cstring>
+
+LockstepEngine::LockstepEngine(int machines)
+{
+    this->machines = machines;
+    groups = (machines + GROUP - 1) / GROUP;
+    state = new Group[groups]();
+    mems = new Memory*[machines];
+    for (int i = 0; i < machines; i++)
+        mems[i] = new Memory(0x10000, &MemoryArena::shared());
+    // Pointed at each machine's memory in turn by step_scalar()
+    scratch = new CPU(nullptr);
+    scratch->report_illegal = false;
+    Registers r = scratch->get_registers();
+    for (int i = 0; i < machines; i++)
+        set_registers(i, r);
+}
+
+LockstepEngine::~LockstepEngine()
+{
+    delete scratch;
+    for (int i = 0; i < machines; i++)
+        delete mems[i];
+    delete[] mems;
+    delete[] state;
+}
+
+void LockstepEngine::load_all(const U8* image, U32 size, U16 address)
+{
+    for (int i = 0; i < machines; i++)
+    {
+        Memory& mem = *mems[i];
+        memcpy(mem.memory + address, image,
+               std::min(size, mem.backing_size - address));
+    }
+}
+
+// scratch <-> one lane of a group
+#define LANE_FIELDS(F)                                                         \
+    F(A, A)                                                                    \
+    F(X, X)                                                                    \
+    F(Y, Y)                                                                    \
+    F(SP, SP)                                                                  \
+    F(PC, PC)                                                                  \
+    F(processor_status, status)                                                \
+    F(flag_c, C)                                                               \
+    F(flag_z, Z)                                                               \
+    F(flag_v, V)                                                               \
+    F(flag_n, N)
+
+Registers LockstepEngine::get_registers(int machine)
+{
+    Group& g = state[machine / GROUP];
+    int lane = machine % GROUP;
+#define F(cpu_field, lane_field) scratch->cpu_field = g.lane_field[lane];
+    LANE_FIELDS(F)
+#undef F
+    return scratch->get_registers();
+}
+
+void LockstepEngine::set_registers(int machine, const Registers& r)
+{
+    Group& g = state[machine / GROUP];
+    int lane = machine % GROUP;
+    scratch->set_registers(r);
+#define F(cpu_field, lane_field) g.lane_field[lane] = scratch->cpu_field;
+    LANE_FIELDS(F)
+#undef F
+}
+
+int LockstepEngine::cycles(int machine)
+{
+    return state[machine / GROUP].cycles[machine % GROUP];
+}
+
+void LockstepEngine::execute(int num_cycles)
+{
+    for (int i = 0; i < groups; i++)
+    {
+        Group& g = state[i];
+        for (int lane = 0; lane < GROUP; lane++)
+            g.cycles[lane] = 0;
+        while (step_group(g, num_cycles, i * GROUP))
+            ;
+    }
+}
+
+// Advances the machines of the group that still have cycles left. Machines
+// are independent, so they need not move together: the ones at the lowest
+// PC go first, which lets lanes that split at a branch meet up again. All
+// running lanes on that opcode take one step, as a vector when possible.
+// Returns false once no machine has cycles left.
+bool LockstepEngine::step_group(Group& g, int num_cycles, int first)
+{
+    U8 live[GROUP], opcode[GROUP], operand[GROUP], operand_hi[GROUP];
+    bool any = false;
+    int lead = -1;
+    for (int lane = 0; lane < GROUP; lane++)
+    {
+        live[lane] = first + lane < machines && g.cycles[lane] < num_cycles;
+        if (!live[lane])
+            continue;
+        any = true;
+        // Peek at the instruction without side effects; fetches from device
+        // pages are left to the CPU
+        Memory* mem = mems[first + lane];
+        U16 pc = g.PC[lane];
+        U8* page = mem->read_map[pc >> 8];
+        U8 *next = page, *last = page;
+        if ((pc & 0xFF) >= 0xFE)
+        {
+            next = mem->read_map[(U16)(pc + 1) >> 8];
+            last = mem->read_map[(U16)(pc + 2) >> 8];
+        }
+        if (!page || !next || !last)
+        {
+            step_scalar(g, lane, mem);
+            stats.scalar_steps++;
+            live[lane] = 0;
+            continue;
+        }
+        opcode[lane] = page[pc & 0xFF];
+        operand[lane] = next[(U16)(pc + 1) & 0xFF];
+        operand_hi[lane] = last[(U16)(pc + 2) & 0xFF];
+        if (lead < 0 || pc < g.PC[lead])
+            lead = lane;
+    }
+    if (lead < 0)
+        return any;
+
+    U8 run[GROUP];
+    for (int lane = 0; lane < GROUP; lane++)
+        run[lane] = live[lane] && opcode[lane] == opcode[lead];
+    if (step_vector(g, run, opcode[lead], operand, operand_hi))
+    {
+        stats.vector_steps++;
+        return true;
+    }
+    for (int lane = 0; lane < GROUP; lane++)
+    {
+        if (!run[lane])
+            continue;
+        step_scalar(g, lane, mems[first + lane]);
+        stats.scalar_steps++;
+    }
+    return true;
+}
+
+void LockstepEngine::step_scalar(Group& g, int lane, Memory* mem)
+{
+    CPU& cpu = *scratch;
+    cpu.mem = mem;
+#define F(cpu_field, lane_field) cpu.cpu_field = g.lane_field[lane];
+    LANE_FIELDS(F)
+#undef F
+    U8 opcode = cpu.read_byte(cpu.PC++);
+    cpu.dispatch(opcode);
+    g.cycles[lane] += opcode_info[opcode].cycles;
+#define F(cpu_field, lane_field) g.lane_field[lane] = cpu.cpu_field;
+    LANE_FIELDS(F)
+#undef F
+}
+
+// Lane versions of op<> from cpu_ops.hpp for the register, immediate and
+// branch forms. mask is 0xFF on lanes that run, imm holds each lane's
+// operand byte, and branches only fill in taken.
+#define LANES for (int l = 0; l < LockstepEngine::GROUP; l++)
+#define SET(r, v) r[l] = ((v) & mask[l]) | (r[l] & ~mask[l])
+
+template <Mnemonic M>
+void LockstepEngine::lanes(Group& g, const U8* mask, const U8* imm, U8* taken)
+{
+    using enum Mnemonic;
+    if constexpr (M == LDA || M == LDX || M == LDY || M == TAX || M == TAY ||
+                  M == TSX || M == TXA || M == TXS || M == TYA)
+    {
+        const U8* from = M == LDA || M == LDX || M == LDY ? imm
+                         : M == TAX || M == TAY           ? g.A
+                         : M == TSX                       ? g.SP
+                         : M == TYA                       ? g.Y
+                                                          : g.X;
+        U8* to = M == LDA || M == TXA || M == TYA ? g.A
+                 : M == LDX || M == TAX || M == TSX ? g.X
+                 : M == TXS                         ? g.SP
+                                                    : g.Y;
+        LANES
+        {
+            U8 v = from[l];
+            SET(to, v);
+            SET(g.Z, v);
+            SET(g.N, v);
+        }
+    }
+    else if constexpr (M == AND || M == ORA || M == EOR)
+    {
+        LANES
+        {
+            U8 v = M == AND   ? g.A[l] & imm[l]
+                   : M == ORA ? g.A[l] | imm[l]
+                              : g.A[l] ^ imm[l];
+            SET(g.A, v);
+            SET(g.Z, v);
+            SET(g.N, v);
+        }
+    }
+    else if constexpr (M == ADC) // binary mode, see step_vector()
+    {
+        LANES
+        {
+            U16 total = g.A[l] + imm[l] + g.C[l];
+            U8 v = total;
+            U8 carry = total >> 8;
+            U8 overflow = (~(g.A[l] ^ imm[l]) & (g.A[l] ^ v)) >> 7 & 1;
+            SET(g.C, carry);
+            SET(g.V, overflow);
+            SET(g.A, v);
+            SET(g.Z, v);
+            SET(g.N, v);
+        }
+    }
+    else if constexpr (M == CMP || M == CPX || M == CPY)
+    {
+        const U8* r = M == CMP ? g.A : M == CPX ? g.X : g.Y;
+        LANES
+        {
+            U8 carry = r[l] >= imm[l];
+            U8 v = r[l] - imm[l];
+            SET(g.C, carry);
+            SET(g.Z, v);
+            SET(g.N, v);
+        }
+    }
+    else if constexpr (M == INX || M == DEX || M == INY || M == DEY)
+    {
+        U8* r = M == INX || M == DEX ? g.X : g.Y;
+        LANES
+        {
+            U8 v = r[l] + (M == INX || M == INY ? 1 : -1);
+            SET(r, v);
+            SET(g.Z, v);
+            SET(g.N, v);
+        }
+    }
+    else if constexpr (M == ASL || M == LSR || M == ROL || M == ROR)
+    {
+        LANES
+        {
+            U8 a = g.A[l];
+            U8 carry = M == ASL || M == ROL ? a >> 7 : a & 1;
+            U8 v = M == ASL   ? a << 1
+                   : M == ROL ? (a << 1) | g.C[l]
+                   : M == LSR ? a >> 1
+                              : (a >> 1) | (g.C[l] << 7);
+            SET(g.C, carry);
+            SET(g.A, v);
+            SET(g.Z, v);
+            SET(g.N, v);
+        }
+    }
+    else if constexpr (M == CLC || M == SEC)
+        LANES SET(g.C, M == SEC);
+    else if constexpr (M == CLV)
+        LANES SET(g.V, 0);
+    else if constexpr (M == CLD || M == SED || M == CLI || M == SEI)
+    {
+        const U8 bit = M == CLD || M == SED ? 1 << DECIMAL_MODE
+                                            : 1 << INTERRUPT_DISABLE;
+        LANES SET(g.status, M == SED || M == SEI ? g.status[l] | bit
+                                                 : g.status[l] & ~bit);
+    }
+    else if constexpr (M == BCC || M == BCS)
+        LANES taken[l] = g.C[l] == (M == BCS);
+    else if constexpr (M == BNE || M == BEQ)
+        LANES taken[l] = (g.Z[l] == 0) == (M == BEQ);
+    else if constexpr (M == BPL || M == BMI)
+        LANES taken[l] = (g.N[l] >> 7) == (M == BMI);
+    else if constexpr (M == BVC || M == BVS)
+        LANES taken[l] = g.V[l] == (M == BVS);
+}
+
+#define VECTOR_OPS(X)                                                          \
+    X(LDA) X(LDX) X(LDY) X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) X(TYA) X(AND)      \
+    X(ORA) X(EOR) X(ADC) X(CMP) X(CPX) X(CPY) X(INX) X(DEX) X(INY) X(DEY)      \
+    X(ASL) X(LSR) X(ROL) X(ROR) X(CLC) X(SEC) X(CLV) X(CLD) X(SED) X(CLI)      \
+    X(SEI) X(BCC) X(BCS) X(BNE) X(BEQ) X(BPL) X(BMI) X(BVC) X(BVS) X(NOP)
+
+// Runs opcode on every live lane at once. Returns false for anything the
+// lane versions and absolute JMP don't cover (memory operands, stack, other
+// jumps) so the caller steps the lanes one by one.
+bool LockstepEngine::step_vector(Group& g, const U8* live, U8 opcode,
+                                 const U8* operand, const U8* operand_hi)
+{
+    const OpcodeInfo& info = opcode_info[opcode];
+    U8 mask[GROUP], imm[GROUP], taken[GROUP] = {};
+    LANES mask[l] = -live[l];
+    LANES imm[l] = operand[l];
+
+    if (info.mnemonic == Mnemonic::JMP && info.mode == Mode::absolute)
+    {
+        bool little = scratch->is_little_endian;
+        LANES
+        {
+            U16 target = little ? imm[l] | (operand_hi[l] << 8)
+                                : operand_hi[l] | (imm[l] << 8);
+            g.PC[l] = (target & (U16)(int8_t)mask[l]) |
+                      (g.PC[l] & ~(U16)(int8_t)mask[l]);
+        }
+        LANES g.cycles[l] += info.cycles & (int8_t)mask[l];
+        return true;
+    }
+    if (info.mode != Mode::implied && info.mode != Mode::accumulator &&
+        info.mode != Mode::immediate && info.mode != Mode::relative)
+        return false;
+
+    if (info.mnemonic == Mnemonic::ADC)
+    {
+        // Decimal mode is left to the CPU
+        U8 decimal = 0;
+        LANES decimal |= g.status[l] & mask[l];
+        if (decimal & (1 << DECIMAL_MODE))
+            return false;
+    }
+
+    switch (info.mnemonic)
+    {
+#define X(mnemonic)                                                            \
+    case Mnemonic::mnemonic:                                                   \
+        lanes<Mnemonic::mnemonic>(g, mask, imm, taken);                        \
+        break;
+        VECTOR_OPS(X)
+#undef X
+    default:
+        return false;
+    }
+
+    // (int8_t)mask widens to all ones on running lanes
+    LANES
+    {
+        U16 offset = taken[l] ? (U16)(int8_t)imm[l] : 0;
+        g.PC[l] += (info.length + offset) & (U16)(int8_t)mask[l];
+    }
+    LANES g.cycles[l] += info.cycles & (int8_t)mask[l];
+    return true;
+}
+
+#undef VECTOR_OPS
+#undef SET
+#undef LANES
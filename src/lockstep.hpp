@@ -0,0 +1,64 @@
+#pragma once
+#include "cpu.hpp"
+
+struct LockstepStats
+{
+    U64 vector_steps = 0; // one instruction for a whole group at once
+    U64 scalar_steps = 0; // one instruction for one machine through a CPU
+};
+
+// Runs many machines side by side, GROUP at a time. Registers and flags are
+// kept as arrays over the machines of a group (same lazy flag layout as
+// CPU), so when every running machine in a group is on the same register or
+// immediate opcode the group advances with plain lane loops the compiler
+// turns into SIMD. Anything else steps each machine through a CPU, so the
+// results match running every machine on its own CPU.
+class LockstepEngine
+{
+public:
+    static const int GROUP = 16;
+
+    LockstepEngine(int machines);
+    ~LockstepEngine();
+
+    int size() { return machines; }
+    Memory& memory(int machine) { return *mems[machine]; }
+    void load_all(const U8* image, U32 size, U16 address);
+
+    Registers get_registers(int machine);
+    void set_registers(int machine, const Registers& r);
+    int cycles(int machine);
+    LockstepStats stats;
+
+    // Like CPU::execute(num_cycles) on every machine
+    void execute(int num_cycles);
+
+private:
+    struct Group
+    {
+        alignas(16) U8 A[GROUP];
+        alignas(16) U8 X[GROUP];
+        alignas(16) U8 Y[GROUP];
+        alignas(16) U8 SP[GROUP];
+        alignas(16) U8 status[GROUP]; // I, D, B and bit 5
+        alignas(16) U8 C[GROUP];
+        alignas(16) U8 Z[GROUP];
+        alignas(16) U8 V[GROUP];
+        alignas(16) U8 N[GROUP];
+        alignas(16) U16 PC[GROUP];
+        alignas(16) int cycles[GROUP];
+    };
+
+    int machines;
+    int groups;
+    Group* state;
+    Memory** mems;
+    CPU* scratch; // runs one machine at a time for the scalar path
+
+    bool step_group(Group& g, int num_cycles, int first);
+    bool step_vector(Group& g, const U8* live, U8 opcode, const U8* operand,
+                     const U8* operand_hi);
+    template <Mnemonic M>
+    static void lanes(Group& g, const U8* mask, const U8* imm, U8* taken);
+    void step_scalar(Group& g, int lane, Memory* mem);
+};
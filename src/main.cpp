@@ -1,14 +1,27 @@
 #include "cpu.hpp"
 #include <iostream>
+#include <new>
 
 int main()
 {
-    Memory mem(65535);
-    CPU cpu(&mem);
-    cpu.print_registers();
-    cpu.execute(1000);
-    cpu.print_stack();
-    cpu.print_registers();
-    cpu.print_flags();
+    try
+    {
+        Memory mem(0x10000);
+        std::cout << mem.mem_size << " bytes allocated" << std::endl;
+        CPU cpu(&mem);
+        cpu.startup_info();
+        cpu.check_endian();
+        mem.load_bin_file();
+        cpu.print_registers();
+        cpu.execute(1000);
+        cpu.print_stack();
+        cpu.print_registers();
+        cpu.print_flags();
+    }
+    catch (std::bad_alloc&)
+    {
+        std::cout << "Failed to allocate memory." << std::endl;
+        return EXIT_FAILURE;
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,56 +1,301 @@
 #include "memory.hpp"
-#include <fstream>
-#include <iomanip>
+#include "loader.hpp"
+#include "rom.hpp"
+#include <cstring>
 #include <iostream>
 
-void Memory::init_memory(U16 size)
+void Memory::init_memory(U32 size)
 {
-    try
+    if (size > 0x10000)
+        size = 0x10000;
+    // Backed in whole pages so the page table never points past the end
+    U32 pages = (size + 0xFF) >> 8;
+    backing_size = pages << 8;
+    if (arena)
     {
-        memory = new U8[size];
-        mem_size = size;
-        std::cout << size << " bytes allocated" << std::endl;
+        // Arena spaces are whole 64K address spaces, handed out zeroed
+        memory = arena->acquire();
+        if (!memory)
+            throw std::bad_alloc();
     }
-    catch (std::bad_alloc&)
+    else
     {
-        std::cout << "Failed to allocate " << size << " bytes of memory."
+        memory = new U8[backing_size];
+        clear_memory();
+    }
+    mem_size = size;
+    for (U32 page = 0; page < 256; page++)
+    {
+        devices[page] = nullptr;
+        shared_pages[page] = nullptr;
+        page_flags[page] = page < pages ? 0 : PAGE_UNMAPPED;
+        update_page(page);
+    }
+}
+
+void Memory::clear_memory() { memset(memory, 0, backing_size); }
+
+void Memory::load_bin_file()
+{
+    Loader loader(this);
+    LoadError error = loader.load_file("data.bin", IMAGE_RAW, 0x0600);
+    if (error == LOAD_OPEN_FAILED)
+        std::cout << "Cannot open binary file" << std::endl;
+    else if (error)
+        std::cout << "Cannot load data.bin: " << Loader::error_string(error)
                   << std::endl;
-        exit(EXIT_FAILURE);
+}
+
+// Bulk copy into the backing store, ROM included. Snapshots and cached code
+// see it like a run of writes. False if it runs past the end of memory.
+bool Memory::load(U32 address, const U8* data, U32 size)
+{
+    if (address + size > backing_size)
+        return false;
+    if (!size)
+        return true;
+    U32 first = address >> 8, last = (address + size - 1) >> 8;
+    for (U32 page = first; page <= last; page++)
+        if (page_flags[page] & PAGE_SNAPSHOT)
+            save_page(page);
+    memcpy(memory + address, data, size);
+    for (U32 page = first; page <= last; page++)
+    {
+        mark_dirty(page);
+        if ((page_flags[page] & PAGE_CODE) && on_code_write)
+            on_code_write(code_write_context, page);
+    }
+    return true;
+}
+
+void Memory::update_page(U8 page)
+{
+    U16 flags = page_flags[page];
+    U8* bytes = flags & PAGE_SHARED ? (U8*)shared_pages[page]
+                                    : memory + (page << 8);
+    // Shared ROM can sit above the end of memory
+    bool readable = (flags & PAGE_SHARED) || !(flags & PAGE_UNMAPPED);
+    read_map[page] = readable && !(flags & (PAGE_DEVICE | PAGE_WATCH_READ |
+                                            PAGE_BREAK))
+                         ? bytes
+                         : nullptr;
+    write_map[page] = flags & (PAGE_UNMAPPED | PAGE_DEVICE | PAGE_ROM |
+                               PAGE_CODE | PAGE_SNAPSHOT | PAGE_WATCH_WRITE |
+                               PAGE_TRACK | PAGE_SYNC)
+                          ? nullptr
+                          : bytes;
+}
+
+void Memory::set_page_flag(U8 page, U16 flag, bool set)
+{
+    if (set)
+        page_flags[page] |= flag;
+    else
+        page_flags[page] &= ~flag;
+    update_page(page);
+}
+
+void Memory::watch(U16 address, U8 kinds)
+{
+    if (!watch_map)
+    {
+        if (!kinds)
+            return;
+        watch_map = new U8[0x10000]();
     }
+    watch_map[address] = kinds;
+    U8 page = address >> 8;
+    U8 all = 0;
+    for (int i = 0; i < 256; i++)
+        all |= watch_map[(page << 8) | i];
+    page_flags[page] &= ~(PAGE_WATCH_READ | PAGE_WATCH_WRITE);
+    if (all & WATCH_READ)
+        page_flags[page] |= PAGE_WATCH_READ;
+    if (all & WATCH_WRITE)
+        page_flags[page] |= PAGE_WATCH_WRITE;
+    update_page(page);
+}
+
+U8 Memory::read_slow(U16 address)
+{
+    U8 page = address >> 8;
+    U16 flags = page_flags[page];
+    if ((flags & PAGE_WATCH_READ) && (watch_map[address] & WATCH_READ) &&
+        on_watch)
+        on_watch(watch_context, address, false);
+    if (flags & PAGE_DEVICE)
+        return devices[page]->read(address);
+    if (flags & PAGE_SHARED)
+        return shared_pages[page][address & 0xFF];
+    if (!(flags & PAGE_UNMAPPED))
+        return memory[address];
+    return 0;
 }
 
-void Memory::clear_memory()
+void Memory::write_slow(U16 address, U8 value)
 {
-    for (U16 i = 0; i < mem_size; i++)
+    U8 page = address >> 8;
+    U16 flags = page_flags[page];
+    if ((flags & PAGE_WATCH_WRITE) && (watch_map[address] & WATCH_WRITE) &&
+        on_watch)
+        on_watch(watch_context, address, true);
+    if (flags & PAGE_DEVICE)
+        devices[page]->write(address, value);
+    else if (!(flags & (PAGE_UNMAPPED | PAGE_ROM)))
     {
-        memory[i] = 0;
+        if (flags & PAGE_SNAPSHOT)
+            save_page(page);
+        if (flags & PAGE_TRACK)
+            mark_dirty(page);
+        memory[address] = value;
+        if ((flags & PAGE_CODE) && on_code_write)
+            on_code_write(code_write_context, page);
+        if ((flags & PAGE_SYNC) && on_sync_write)
+            on_sync_write(sync_context, address, value);
     }
 }
 
-void Memory::load_bin_file()
+void Memory::map_device(U8 first_page, int pages, Device* device)
 {
-    std::ifstream bin_file("data.bin", std::ios::in | std::ios::binary);
-    if (!bin_file)
+    for (int i = 0; i < pages; i++)
     {
-        std::cout << "Cannot open binary file" << std::endl;
+        devices[(first_page + i) & 0xFF] = device;
+        set_page_flag(first_page + i, PAGE_DEVICE, true);
     }
-    uint8_t byte;
-    char tmp;
-    uint16_t counter = 0x0600;
-    while (bin_file)
+}
+
+void Memory::unmap_device(U8 first_page, int pages)
+{
+    for (int i = 0; i < pages; i++)
     {
-        bin_file.get(tmp);
-        byte = tmp;
-        memory[counter] = byte;
-        counter++;
+        devices[(first_page + i) & 0xFF] = nullptr;
+        set_page_flag(first_page + i, PAGE_DEVICE, false);
     }
-    bin_file.close();
 }
 
-Memory::Memory(U16 size)
+void Memory::set_rom(U8 first_page, int pages, bool rom)
+{
+    for (int i = 0; i < pages; i++)
+        set_page_flag(first_page + i, PAGE_ROM, rom);
+}
+
+bool Memory::map_rom(U8 first_page, const SharedRom& rom)
+{
+    if (first_page + rom.pages() > 256)
+        return false;
+    for (int i = 0; i < rom.pages(); i++)
+    {
+        U8 page = first_page + i;
+        shared_pages[page] = rom.bytes + (i << 8);
+        page_flags[page] |= PAGE_SHARED | PAGE_ROM;
+        update_page(page);
+        // Cached code there came from the old bytes
+        if ((page_flags[page] & PAGE_CODE) && on_code_write)
+            on_code_write(code_write_context, page);
+    }
+    return true;
+}
+
+void Memory::unmap_rom(U8 first_page, int pages)
+{
+    for (int i = 0; i < pages; i++)
+    {
+        U8 page = (first_page + i) & 0xFF;
+        if (!(page_flags[page] & PAGE_SHARED))
+            continue;
+        shared_pages[page] = nullptr;
+        page_flags[page] &= ~(PAGE_SHARED | PAGE_ROM);
+        update_page(page);
+        if ((page_flags[page] & PAGE_CODE) && on_code_write)
+            on_code_write(code_write_context, page);
+    }
+}
+
+void Memory::snapshot()
+{
+    if (!saved_pages)
+        saved_pages = new U8[backing_size];
+    for (U32 page = 0; page < backing_size >> 8; page++)
+        set_page_flag(page, PAGE_SNAPSHOT, true);
+    dirty_count = 0;
+    has_snapshot = true;
+}
+
+void Memory::save_page(U8 page)
+{
+    memcpy(saved_pages + (page << 8), memory + (page << 8), 256);
+    dirty_pages[dirty_count++] = page;
+    set_page_flag(page, PAGE_SNAPSHOT, false);
+}
+
+void Memory::restore()
+{
+    if (!has_snapshot)
+        return;
+    for (int i = 0; i < dirty_count; i++)
+    {
+        U8 page = dirty_pages[i];
+        memcpy(memory + (page << 8), saved_pages + (page << 8), 256);
+        set_page_flag(page, PAGE_SNAPSHOT, true);
+        mark_dirty(page);
+        if ((page_flags[page] & PAGE_CODE) && on_code_write)
+            on_code_write(code_write_context, page);
+    }
+    dirty_count = 0;
+}
+
+void Memory::drop_snapshot()
+{
+    for (int page = 0; page < 256; page++)
+        set_page_flag(page, PAGE_SNAPSHOT, false);
+    dirty_count = 0;
+    has_snapshot = false;
+}
+
+void Memory::track_writes(bool track)
+{
+    tracking = track;
+    memset(dirty_bitmap, 0, sizeof dirty_bitmap);
+    for (U32 page = 0; page < backing_size >> 8; page++)
+        set_page_flag(page, PAGE_TRACK, track);
+}
+
+// Only dirty pages lost their trap, so only they are re-armed
+void Memory::clear_dirty()
+{
+    for (int word = 0; word < 4; word++)
+    {
+        U64 bits = dirty_bitmap[word];
+        dirty_bitmap[word] = 0;
+        for (; bits; bits &= bits - 1)
+        {
+            U32 page = word * 64 + __builtin_ctzll(bits);
+            if (tracking && page < backing_size >> 8)
+                set_page_flag(page, PAGE_TRACK, true);
+        }
+    }
+}
+
+void Memory::mark_dirty(U8 page)
+{
+    if (!tracking)
+        return;
+    dirty_bitmap[page >> 6] |= (U64)1 << (page & 63);
+    if (page_flags[page] & PAGE_TRACK)
+        set_page_flag(page, PAGE_TRACK, false);
+}
+
+Memory::Memory(U32 size, MemoryArena* arena) : arena(arena)
 {
     init_memory(size);
-    clear_memory();
 }
 
-Memory::~Memory() { delete memory; }
\ No newline at end of file
+Memory::~Memory()
+{
+    if (arena)
+        arena->release(memory);
+    else
+        delete[] memory;
+    delete[] saved_pages;
+    delete[] watch_map;
+}
\ No newline at end of file
@@ -1,17 +1,159 @@
+#pragma once
+#include "arena.hpp"
 #include <iostream>
 
 #define U8 uint8_t
 #define U16 uint16_t
+#define U32 uint32_t
+#define U64 uint64_t
+
+// Memory mapped peripheral. Gets the full 16 bit address of every access to
+// the pages it is mapped on.
+class Device
+{
+public:
+    virtual U8 read(U16 address) = 0;
+    virtual void write(U16 address, U8 value) = 0;
+    virtual ~Device() {}
+};
+
+enum
+{
+    PAGE_UNMAPPED = 1 << 0, // past the end of memory, reads 0, ignores writes
+    PAGE_DEVICE = 1 << 1,   // accesses go to devices[page]
+    PAGE_ROM = 1 << 2,      // writes are ignored
+    PAGE_CODE = 1 << 3,     // writes are reported through on_code_write
+    PAGE_SNAPSHOT = 1 << 4, // first write saves the page for restore()
+    PAGE_SHARED = 1 << 5,   // reads come from shared_pages[page], see map_rom
+    PAGE_WATCH_READ = 1 << 6,  // holds a read watchpoint, see watch()
+    PAGE_WATCH_WRITE = 1 << 7, // holds a write watchpoint
+    PAGE_BREAK = 1 << 8,       // holds a breakpoint, so fetches take the
+                               // slow path, see CPU::fetch()
+    PAGE_TRACK = 1 << 9,       // first write marks the page dirty
+    PAGE_SYNC = 1 << 10,       // writes are reported through on_sync_write,
+                               // see System
+};
+
+// Bits in Memory::watch_map
+enum
+{
+    WATCH_READ = 1 << 0,
+    WATCH_WRITE = 1 << 1,
+};
+
+class SharedRom;
 
 class Memory
 {
 public:
-    U16 mem_size;
+    U32 mem_size;     // up to 0x10000
+    U32 backing_size; // mem_size rounded up to whole pages
     U8* memory;
 
-    void init_memory(U16 size);
+    // Page table. A non-null entry points at the 256 bytes backing the page
+    // and the access is a plain load or store; null sends it to read_slow()
+    // or write_slow(), which look at page_flags.
+    U8* read_map[256];
+    U8* write_map[256];
+    Device* devices[256];
+    const U8* shared_pages[256]; // ROM bytes backing PAGE_SHARED pages
+    U16 page_flags[256];
+
+    // Called after a write lands on a PAGE_CODE page
+    void (*on_code_write)(void* context, U8 page) = nullptr;
+    void* code_write_context = nullptr;
+
+    // WATCH_READ/WATCH_WRITE per address, allocated by the first watch().
+    // Pages holding a watched address take the slow path for that kind of
+    // access, which reports hits through on_watch before doing the access.
+    U8* watch_map = nullptr;
+    void (*on_watch)(void* context, U16 address, bool write) = nullptr;
+    void* watch_context = nullptr;
+
+    // Called after a write lands on a PAGE_SYNC page
+    void (*on_sync_write)(void* context, U16 address, U8 value) = nullptr;
+    void* sync_context = nullptr;
+
+    U8 read(U16 address)
+    {
+        U8* page = read_map[address >> 8];
+        if (page) [[likely]]
+            return page[address & 0xFF];
+        return read_slow(address);
+    }
+
+    void write(U16 address, U8 value)
+    {
+        U8* page = write_map[address >> 8];
+        if (page) [[likely]]
+            page[address & 0xFF] = value;
+        else
+            write_slow(address, value);
+    }
+
+    // What the CPU would read, without device side effects (device pages
+    // show the backing store); 0 past the end
+    U8 peek(U16 address) const
+    {
+        U8 page = address >> 8;
+        if (page_flags[page] & PAGE_SHARED) [[unlikely]]
+            return shared_pages[page][address & 0xFF];
+        return address < backing_size ? memory[address] : 0;
+    }
+
+    U8 read_slow(U16 address);
+    void write_slow(U16 address, U8 value);
+    void map_device(U8 first_page, int pages, Device* device);
+    void unmap_device(U8 first_page, int pages);
+    void set_rom(U8 first_page, int pages, bool rom);
+    // Reads of the pages from first_page on come from rom, writes are
+    // ignored; this Memory's own bytes there are left alone. The pages may
+    // lie past mem_size, so a machine can be given only its RAM. False if
+    // rom would run past 0xFFFF.
+    bool map_rom(U8 first_page, const SharedRom& rom);
+    void unmap_rom(U8 first_page, int pages);
+    void set_page_flag(U8 page, U16 flag, bool set);
+    // Sets the watched kinds of access for address, 0 to stop watching it
+    void watch(U16 address, U8 kinds);
+    bool load(U32 address, const U8* data, U32 size);
+
+    // Copy-on-write snapshot. Pages are shared with the snapshot until their
+    // first write, which saves the old contents; restore() copies back only
+    // those. Writes made straight into memory[] are not seen.
+    void snapshot();
+    void restore();
+    void drop_snapshot();
+
+    // Dirty page tracking, for incremental checkpoints. While on, the first
+    // write to a page since track_writes() or clear_dirty() sets its bit in
+    // dirty_bitmap and untraps the page, so later writes are plain stores.
+    // Bulk loads and restore() count as writes; writes made straight into
+    // memory[] are not seen.
+    U64 dirty_bitmap[4] = {};
+    void track_writes(bool track);
+    void clear_dirty();
+    bool page_dirty(U8 page) const
+    {
+        return (dirty_bitmap[page >> 6] >> (page & 63)) & 1;
+    }
+
+    void init_memory(U32 size);
     void clear_memory();
     void load_bin_file();
-    Memory(U16 size);
+    // The backing store comes from arena when given, else from the heap.
+    // Throws std::bad_alloc when it cannot be had.
+    Memory(U32 size = 0x10000, MemoryArena* arena = nullptr);
     ~Memory();
-};
\ No newline at end of file
+
+private:
+    void update_page(U8 page);
+    void save_page(U8 page);
+    void mark_dirty(U8 page);
+
+    MemoryArena* arena;
+    U8* saved_pages = nullptr; // contents at snapshot() of the dirty pages
+    U8 dirty_pages[256];
+    int dirty_count = 0;
+    bool has_snapshot = false;
+    bool tracking = false;
+};
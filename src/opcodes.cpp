@@ -0,0 +1,51 @@
+#include "opcodes.hpp"
+#include <cstdio>
+
+int disassemble(U16 pc, const U8* bytes, char* text, size_t size)
+{
+    const OpcodeInfo& info = opcode_info[bytes[0]];
+    U8 lo = bytes[1];
+    U16 word = lo | bytes[2] << 8;
+    switch (info.mode)
+    {
+    case Mode::accumulator:
+        snprintf(text, size, "%s A", info.name);
+        break;
+    case Mode::immediate:
+        snprintf(text, size, "%s #$%02X", info.name, lo);
+        break;
+    case Mode::absolute:
+        snprintf(text, size, "%s $%04X", info.name, word);
+        break;
+    case Mode::zero_page:
+        snprintf(text, size, "%s $%02X", info.name, lo);
+        break;
+    case Mode::abs_x:
+        snprintf(text, size, "%s $%04X,X", info.name, word);
+        break;
+    case Mode::abs_y:
+        snprintf(text, size, "%s $%04X,Y", info.name, word);
+        break;
+    case Mode::zero_x:
+        snprintf(text, size, "%s $%02X,X", info.name, lo);
+        break;
+    case Mode::zero_y:
+        snprintf(text, size, "%s $%02X,Y", info.name, lo);
+        break;
+    case Mode::abs_indirect:
+        snprintf(text, size, "%s ($%04X)", info.name, word);
+        break;
+    case Mode::inx:
+        snprintf(text, size, "%s ($%02X,X)", info.name, lo);
+        break;
+    case Mode::iny:
+        snprintf(text, size, "%s ($%02X),Y", info.name, lo);
+        break;
+    case Mode::relative:
+        snprintf(text, size, "%s $%04X", info.name, (U16)(pc + 2 + (int8_t)lo));
+        break;
+    default:
+        snprintf(text, size, "%s", info.name);
+    }
+    return info.length;
+}
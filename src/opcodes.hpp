@@ -0,0 +1,385 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#define U8 uint8_t
+#define U16 uint16_t
+
+enum class Mnemonic : U8
+{
+    ADC,
+    AND,
+    ASL,
+    BCC,
+    BCS,
+    BEQ,
+    BIT,
+    BMI,
+    BNE,
+    BPL,
+    BRK,
+    BVC,
+    BVS,
+    CLC,
+    CLD,
+    CLI,
+    CLV,
+    CMP,
+    CPX,
+    CPY,
+    DEC,
+    DEX,
+    DEY,
+    EOR,
+    INC,
+    INX,
+    INY,
+    JMP,
+    JSR,
+    LDA,
+    LDX,
+    LDY,
+    LSR,
+    NOP,
+    ORA,
+    PHA,
+    PHP,
+    PLA,
+    PLP,
+    ROL,
+    ROR,
+    RTI,
+    RTS,
+    SBC,
+    SEC,
+    SED,
+    SEI,
+    STA,
+    STX,
+    STY,
+    TAX,
+    TAY,
+    TSX,
+    TXA,
+    TXS,
+    TYA,
+    ILLEGAL
+};
+
+enum class Mode : U8
+{
+    implied,
+    accumulator,
+    immediate,
+    absolute,
+    zero_page,
+    abs_x,
+    abs_y,
+    zero_x,
+    zero_y,
+    abs_indirect,
+    inx,
+    iny,
+    relative,
+    illegal_mode
+};
+
+struct OpcodeInfo
+{
+    Mnemonic mnemonic;
+    Mode mode;
+    U8 cycles; // base cycle count
+    U8 length; // instruction length in bytes, opcode included
+    const char* name;
+};
+
+// Opcode map, one entry per opcode byte in ascending order:
+// X(opcode, mnemonic, addressing mode, cycles)
+// OPCODE numbers taken from https://www.pagetable.com/c64ref/6502/?tab=3
+#define OPCODE_LIST(X) \
+    X(00, BRK, implied, 7) \
+    X(01, ORA, inx, 6) \
+    X(02, ILLEGAL, illegal_mode, 1) \
+    X(03, ILLEGAL, illegal_mode, 1) \
+    X(04, ILLEGAL, illegal_mode, 1) \
+    X(05, ORA, zero_page, 3) \
+    X(06, ASL, zero_page, 5) \
+    X(07, ILLEGAL, illegal_mode, 1) \
+    X(08, PHP, implied, 3) \
+    X(09, ORA, immediate, 2) \
+    X(0A, ASL, accumulator, 2) \
+    X(0B, ILLEGAL, illegal_mode, 1) \
+    X(0C, ILLEGAL, illegal_mode, 1) \
+    X(0D, ORA, absolute, 4) \
+    X(0E, ASL, absolute, 6) \
+    X(0F, ILLEGAL, illegal_mode, 1) \
+    X(10, BPL, relative, 2) \
+    X(11, ORA, iny, 5) \
+    X(12, ILLEGAL, illegal_mode, 1) \
+    X(13, ILLEGAL, illegal_mode, 1) \
+    X(14, ILLEGAL, illegal_mode, 1) \
+    X(15, ORA, zero_x, 4) \
+    X(16, ASL, zero_x, 6) \
+    X(17, ILLEGAL, illegal_mode, 1) \
+    X(18, CLC, implied, 2) \
+    X(19, ORA, abs_y, 4) \
+    X(1A, ILLEGAL, illegal_mode, 1) \
+    X(1B, ILLEGAL, illegal_mode, 1) \
+    X(1C, ILLEGAL, illegal_mode, 1) \
+    X(1D, ORA, abs_x, 4) \
+    X(1E, ASL, abs_x, 7) \
+    X(1F, ILLEGAL, illegal_mode, 1) \
+    X(20, JSR, absolute, 6) \
+    X(21, AND, inx, 6) \
+    X(22, ILLEGAL, illegal_mode, 1) \
+    X(23, ILLEGAL, illegal_mode, 1) \
+    X(24, BIT, zero_page, 3) \
+    X(25, AND, zero_page, 3) \
+    X(26, ROL, zero_page, 5) \
+    X(27, ILLEGAL, illegal_mode, 1) \
+    X(28, PLP, implied, 4) \
+    X(29, AND, immediate, 2) \
+    X(2A, ROL, accumulator, 2) \
+    X(2B, ILLEGAL, illegal_mode, 1) \
+    X(2C, BIT, absolute, 4) \
+    X(2D, AND, absolute, 4) \
+    X(2E, ROL, absolute, 6) \
+    X(2F, ILLEGAL, illegal_mode, 1) \
+    X(30, BMI, relative, 2) \
+    X(31, AND, iny, 5) \
+    X(32, ILLEGAL, illegal_mode, 1) \
+    X(33, ILLEGAL, illegal_mode, 1) \
+    X(34, ILLEGAL, illegal_mode, 1) \
+    X(35, AND, zero_x, 4) \
+    X(36, ROL, zero_x, 6) \
+    X(37, ILLEGAL, illegal_mode, 1) \
+    X(38, SEC, implied, 2) \
+    X(39, AND, abs_y, 4) \
+    X(3A, ILLEGAL, illegal_mode, 1) \
+    X(3B, ILLEGAL, illegal_mode, 1) \
+    X(3C, ILLEGAL, illegal_mode, 1) \
+    X(3D, AND, abs_x, 4) \
+    X(3E, ROL, abs_x, 7) \
+    X(3F, ILLEGAL, illegal_mode, 1) \
+    X(40, RTI, implied, 6) \
+    X(41, EOR, inx, 6) \
+    X(42, ILLEGAL, illegal_mode, 1) \
+    X(43, ILLEGAL, illegal_mode, 1) \
+    X(44, ILLEGAL, illegal_mode, 1) \
+    X(45, EOR, zero_page, 3) \
+    X(46, LSR, zero_page, 5) \
+    X(47, ILLEGAL, illegal_mode, 1) \
+    X(48, PHA, implied, 3) \
+    X(49, EOR, immediate, 2) \
+    X(4A, LSR, accumulator, 2) \
+    X(4B, ILLEGAL, illegal_mode, 1) \
+    X(4C, JMP, absolute, 3) \
+    X(4D, EOR, absolute, 4) \
+    X(4E, LSR, absolute, 6) \
+    X(4F, ILLEGAL, illegal_mode, 1) \
+    X(50, BVC, relative, 2) \
+    X(51, EOR, iny, 5) \
+    X(52, ILLEGAL, illegal_mode, 1) \
+    X(53, ILLEGAL, illegal_mode, 1) \
+    X(54, ILLEGAL, illegal_mode, 1) \
+    X(55, EOR, zero_x, 4) \
+    X(56, LSR, zero_x, 6) \
+    X(57, ILLEGAL, illegal_mode, 1) \
+    X(58, CLI, implied, 2) \
+    X(59, EOR, abs_y, 4) \
+    X(5A, ILLEGAL, illegal_mode, 1) \
+    X(5B, ILLEGAL, illegal_mode, 1) \
+    X(5C, ILLEGAL, illegal_mode, 1) \
+    X(5D, EOR, abs_x, 4) \
+    X(5E, LSR, abs_x, 7) \
+    X(5F, ILLEGAL, illegal_mode, 1) \
+    X(60, RTS, implied, 6) \
+    X(61, ADC, inx, 6) \
+    X(62, ILLEGAL, illegal_mode, 1) \
+    X(63, ILLEGAL, illegal_mode, 1) \
+    X(64, ILLEGAL, illegal_mode, 1) \
+    X(65, ADC, zero_page, 3) \
+    X(66, ROR, zero_page, 5) \
+    X(67, ILLEGAL, illegal_mode, 1) \
+    X(68, PLA, implied, 4) \
+    X(69, ADC, immediate, 2) \
+    X(6A, ROR, accumulator, 2) \
+    X(6B, ILLEGAL, illegal_mode, 1) \
+    X(6C, JMP, abs_indirect, 5) \
+    X(6D, ADC, absolute, 4) \
+    X(6E, ROR, absolute, 6) \
+    X(6F, ILLEGAL, illegal_mode, 1) \
+    X(70, BVS, relative, 2) \
+    X(71, ADC, iny, 5) \
+    X(72, ILLEGAL, illegal_mode, 1) \
+    X(73, ILLEGAL, illegal_mode, 1) \
+    X(74, ILLEGAL, illegal_mode, 1) \
+    X(75, ADC, zero_x, 4) \
+    X(76, ROR, zero_x, 6) \
+    X(77, ILLEGAL, illegal_mode, 1) \
+    X(78, SEI, implied, 2) \
+    X(79, ADC, abs_y, 4) \
+    X(7A, ILLEGAL, illegal_mode, 1) \
+    X(7B, ILLEGAL, illegal_mode, 1) \
+    X(7C, ILLEGAL, illegal_mode, 1) \
+    X(7D, ADC, abs_x, 4) \
+    X(7E, ROR, abs_x, 7) \
+    X(7F, ILLEGAL, illegal_mode, 1) \
+    X(80, ILLEGAL, illegal_mode, 1) \
+    X(81, STA, inx, 6) \
+    X(82, ILLEGAL, illegal_mode, 1) \
+    X(83, ILLEGAL, illegal_mode, 1) \
+    X(84, STY, zero_page, 3) \
+    X(85, STA, zero_page, 3) \
+    X(86, STX, zero_page, 3) \
+    X(87, ILLEGAL, illegal_mode, 1) \
+    X(88, DEY, implied, 2) \
+    X(89, ILLEGAL, illegal_mode, 1) \
+    X(8A, TXA, implied, 2) \
+    X(8B, ILLEGAL, illegal_mode, 1) \
+    X(8C, STY, absolute, 4) \
+    X(8D, STA, absolute, 4) \
+    X(8E, STX, absolute, 4) \
+    X(8F, ILLEGAL, illegal_mode, 1) \
+    X(90, BCC, relative, 2) \
+    X(91, STA, iny, 6) \
+    X(92, ILLEGAL, illegal_mode, 1) \
+    X(93, ILLEGAL, illegal_mode, 1) \
+    X(94, STY, zero_x, 4) \
+    X(95, STA, zero_x, 4) \
+    X(96, STX, zero_y, 4) \
+    X(97, ILLEGAL, illegal_mode, 1) \
+    X(98, TYA, implied, 2) \
+    X(99, STA, abs_y, 5) \
+    X(9A, TXS, implied, 2) \
+    X(9B, ILLEGAL, illegal_mode, 1) \
+    X(9C, ILLEGAL, illegal_mode, 1) \
+    X(9D, STA, abs_x, 5) \
+    X(9E, ILLEGAL, illegal_mode, 1) \
+    X(9F, ILLEGAL, illegal_mode, 1) \
+    X(A0, LDY, immediate, 2) \
+    X(A1, LDA, inx, 6) \
+    X(A2, LDX, immediate, 2) \
+    X(A3, ILLEGAL, illegal_mode, 1) \
+    X(A4, LDY, zero_page, 3) \
+    X(A5, LDA, zero_page, 3) \
+    X(A6, LDX, zero_page, 3) \
+    X(A7, ILLEGAL, illegal_mode, 1) \
+    X(A8, TAY, implied, 2) \
+    X(A9, LDA, immediate, 2) \
+    X(AA, TAX, implied, 2) \
+    X(AB, ILLEGAL, illegal_mode, 1) \
+    X(AC, LDY, absolute, 4) \
+    X(AD, LDA, absolute, 4) \
+    X(AE, LDX, absolute, 4) \
+    X(AF, ILLEGAL, illegal_mode, 1) \
+    X(B0, BCS, relative, 2) \
+    X(B1, LDA, iny, 5) \
+    X(B2, ILLEGAL, illegal_mode, 1) \
+    X(B3, ILLEGAL, illegal_mode, 1) \
+    X(B4, LDY, zero_x, 4) \
+    X(B5, LDA, zero_x, 4) \
+    X(B6, LDX, zero_y, 4) \
+    X(B7, ILLEGAL, illegal_mode, 1) \
+    X(B8, CLV, implied, 2) \
+    X(B9, LDA, abs_y, 4) \
+    X(BA, TSX, implied, 2) \
+    X(BB, ILLEGAL, illegal_mode, 1) \
+    X(BC, LDY, abs_x, 4) \
+    X(BD, LDA, abs_x, 4) \
+    X(BE, LDX, abs_y, 4) \
+    X(BF, ILLEGAL, illegal_mode, 1) \
+    X(C0, CPY, immediate, 2) \
+    X(C1, CMP, inx, 6) \
+    X(C2, ILLEGAL, illegal_mode, 1) \
+    X(C3, ILLEGAL, illegal_mode, 1) \
+    X(C4, CPY, zero_page, 3) \
+    X(C5, CMP, zero_page, 3) \
+    X(C6, DEC, zero_page, 5) \
+    X(C7, ILLEGAL, illegal_mode, 1) \
+    X(C8, INY, implied, 2) \
+    X(C9, CMP, immediate, 2) \
+    X(CA, DEX, implied, 2) \
+    X(CB, ILLEGAL, illegal_mode, 1) \
+    X(CC, CPY, absolute, 4) \
+    X(CD, CMP, absolute, 4) \
+    X(CE, DEC, absolute, 6) \
+    X(CF, ILLEGAL, illegal_mode, 1) \
+    X(D0, BNE, relative, 2) \
+    X(D1, CMP, iny, 5) \
+    X(D2, ILLEGAL, illegal_mode, 1) \
+    X(D3, ILLEGAL, illegal_mode, 1) \
+    X(D4, ILLEGAL, illegal_mode, 1) \
+    X(D5, CMP, zero_x, 4) \
+    X(D6, DEC, zero_x, 6) \
+    X(D7, ILLEGAL, illegal_mode, 1) \
+    X(D8, CLD, implied, 2) \
+    X(D9, CMP, abs_y, 4) \
+    X(DA, ILLEGAL, illegal_mode, 1) \
+    X(DB, ILLEGAL, illegal_mode, 1) \
+    X(DC, ILLEGAL, illegal_mode, 1) \
+    X(DD, CMP, abs_x, 4) \
+    X(DE, DEC, abs_x, 7) \
+    X(DF, ILLEGAL, illegal_mode, 1) \
+    X(E0, CPX, immediate, 2) \
+    X(E1, SBC, inx, 6) \
+    X(E2, ILLEGAL, illegal_mode, 1) \
+    X(E3, ILLEGAL, illegal_mode, 1) \
+    X(E4, CPX, zero_page, 3) \
+    X(E5, SBC, zero_page, 3) \
+    X(E6, INC, zero_page, 5) \
+    X(E7, ILLEGAL, illegal_mode, 1) \
+    X(E8, INX, implied, 2) \
+    X(E9, SBC, immediate, 2) \
+    X(EA, NOP, implied, 2) \
+    X(EB, ILLEGAL, illegal_mode, 1) \
+    X(EC, CPX, absolute, 4) \
+    X(ED, SBC, absolute, 4) \
+    X(EE, INC, absolute, 6) \
+    X(EF, ILLEGAL, illegal_mode, 1) \
+    X(F0, BEQ, relative, 2) \
+    X(F1, SBC, iny, 5) \
+    X(F2, ILLEGAL, illegal_mode, 1) \
+    X(F3, ILLEGAL, illegal_mode, 1) \
+    X(F4, ILLEGAL, illegal_mode, 1) \
+    X(F5, SBC, zero_x, 4) \
+    X(F6, INC, zero_x, 6) \
+    X(F7, ILLEGAL, illegal_mode, 1) \
+    X(F8, SED, implied, 2) \
+    X(F9, SBC, abs_y, 4) \
+    X(FA, ILLEGAL, illegal_mode, 1) \
+    X(FB, ILLEGAL, illegal_mode, 1) \
+    X(FC, ILLEGAL, illegal_mode, 1) \
+    X(FD, SBC, abs_x, 4) \
+    X(FE, INC, abs_x, 7) \
+    X(FF, ILLEGAL, illegal_mode, 1)
+
+constexpr U8 mode_length(Mode mode)
+{
+    switch (mode)
+    {
+    case Mode::implied:
+    case Mode::accumulator:
+    case Mode::illegal_mode:
+        return 1;
+    case Mode::absolute:
+    case Mode::abs_x:
+    case Mode::abs_y:
+    case Mode::abs_indirect:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+constexpr OpcodeInfo opcode_info[256] = {
+#define X(op, mnemonic, mode, cycles)                                          \
+    {Mnemonic::mnemonic, Mode::mode, cycles, mode_length(Mode::mode),          \
+     #mnemonic},
+    OPCODE_LIST(X)
+#undef X
+};
+
+// Writes the instruction in bytes[0..2], located at pc, as assembly text.
+// Returns its length.
+int disassemble(U16 pc, const U8* bytes, char* text, size_t size);
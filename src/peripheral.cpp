@@ -0,0 +1,86 @@
+#include "peripheral.hpp"
+
+void Peripheral::attach(CPU& cpu, U8 first_page, int pages)
+{
+    detach();
+    this->cpu = &cpu;
+    mem = cpu.memory();
+    this->first_page = first_page;
+    this->pages = pages;
+    mem->map_device(first_page, pages, this);
+    task = new PeripheralTask(run());
+    task->handle.resume();
+}
+
+void Peripheral::detach()
+{
+    if (!task)
+        return;
+    if (event)
+        cpu->cancel_event(event);
+    event = 0;
+    waiting = nullptr;
+    writes.clear();
+    mem->unmap_device(first_page, pages);
+    delete task;
+    task = nullptr;
+}
+
+Peripheral::~Peripheral() { detach(); }
+
+void Peripheral::wait(std::coroutine_handle<> h, U64 when, bool write)
+{
+    waiting = h;
+    wants_write = write;
+    if (when != Scheduler::NEVER)
+        event = cpu->schedule(when, &Peripheral::wake, this);
+}
+
+void Peripheral::resume()
+{
+    std::coroutine_handle<> h = waiting;
+    waiting = nullptr;
+    h.resume();
+}
+
+void Peripheral::wake(void* context, CPU&)
+{
+    Peripheral* device = (Peripheral*)context;
+    device->event = 0;
+    device->result.timed_out = true;
+    device->resume();
+}
+
+void Peripheral::write(U16 address, U8 value)
+{
+    BusWrite w = {address, value, false};
+    if (waiting && wants_write)
+    {
+        if (event)
+            cpu->cancel_event(event);
+        event = 0;
+        result = w;
+        resume();
+    }
+    else if (task && writes.size() < WRITE_QUEUE)
+        writes.push_back(w);
+}
+
+void Peripheral::Until::await_suspend(std::coroutine_handle<> h)
+{
+    device->wait(h, when, false);
+}
+
+void Peripheral::NextWrite::await_suspend(std::coroutine_handle<> h)
+{
+    device->wait(h, deadline, true);
+}
+
+BusWrite Peripheral::NextWrite::await_resume()
+{
+    if (device->writes.empty())
+        return device->result;
+    BusWrite w = device->writes.front();
+    device->writes.pop_front();
+    return w;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "cpu.hpp"
+#include <coroutine>
+#include <deque>
+#include <exception>
+
+// Body of a Peripheral. Starts suspended; only its Peripheral resumes it.
+class PeripheralTask
+{
+public:
+    struct promise_type
+    {
+        PeripheralTask get_return_object()
+        {
+            return PeripheralTask(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    PeripheralTask(PeripheralTask&& other) : handle(other.handle)
+    {
+        other.handle = nullptr;
+    }
+    ~PeripheralTask()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+private:
+    explicit PeripheralTask(std::coroutine_handle<promise_type> h) : handle(h)
+    {
+    }
+};
+
+struct BusWrite
+{
+    U16 address;
+    U8 value;
+    bool timed_out; // the deadline came first, address and value unset
+};
+
+// Memory mapped device whose behaviour is the coroutine run(). It co_awaits
+// a cycle count or the next write to its registers, and is resumed by a
+// scheduler event or by that write, so between those it costs the CPU
+// nothing. Resumptions happen at instruction boundaries (events) or inside
+// the writing instruction, with cycles() already past it. Register reads
+// are plain read() overrides.
+class Peripheral : public Device
+{
+public:
+    static const int WRITE_QUEUE = 16;
+
+    // Maps the device on the pages and runs run() up to its first co_await
+    void attach(CPU& cpu, U8 first_page, int pages = 1);
+    void detach();
+    void write(U16 address, U8 value) final;
+    virtual ~Peripheral();
+
+protected:
+    CPU* cpu = nullptr;
+
+    virtual PeripheralTask run() = 0;
+    U64 now() { return cpu->cycles(); }
+
+    struct Until
+    {
+        Peripheral* device;
+        U64 when;
+        bool await_ready() { return when <= device->now(); }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() {}
+    };
+
+    struct NextWrite
+    {
+        Peripheral* device;
+        U64 deadline;
+        bool await_ready() { return !device->writes.empty(); }
+        void await_suspend(std::coroutine_handle<> h);
+        BusWrite await_resume();
+    };
+
+    // Resumes at the first instruction boundary at or after cycle when
+    Until until(U64 when) { return Until{this, when}; }
+    Until delay(U64 cycles) { return Until{this, now() + cycles}; }
+    // Resumes with the next write to the device, or timed out at deadline.
+    // Writes made while the coroutine waits on something else are queued,
+    // up to WRITE_QUEUE; later ones are dropped.
+    NextWrite next_write(U64 deadline = Scheduler::NEVER)
+    {
+        return NextWrite{this, deadline};
+    }
+    int queued_writes() { return writes.size(); }
+
+private:
+    PeripheralTask* task = nullptr;
+    Memory* mem = nullptr;
+    U8 first_page = 0;
+    int pages = 0;
+
+    std::coroutine_handle<> waiting; // suspended in until() or next_write()
+    bool wants_write = false;
+    U32 event = 0; // pending scheduler event, 0 for none
+    std::deque<BusWrite> writes;
+    BusWrite result;
+
+    void wait(std::coroutine_handle<> h, U64 when, bool write);
+    void resume();
+    static void wake(void* context, CPU& cpu);
+};
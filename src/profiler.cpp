@@ -0,0 +1,70 @@
+#include "profiler.hpp"
+#include "opcodes.hpp"
+#include <cstdio>
+#include <cstring>
+
+void Profiler::clear()
+{
+    memset(opcode_count, 0, sizeof opcode_count);
+    memset(opcode_cycles, 0, sizeof opcode_cycles);
+    memset(pc_count, 0, sizeof pc_count);
+    memset(pc_cycles, 0, sizeof pc_cycles);
+}
+
+U64 Profiler::total_cycles()
+{
+    U64 total = 0;
+    for (int opcode = 0; opcode < 256; opcode++)
+        total += opcode_cycles[opcode];
+    return total;
+}
+
+bool Profiler::write_csv(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "kind,key,count,cycles\n");
+    for (int opcode = 0; opcode < 256; opcode++)
+        if (opcode_count[opcode])
+            fprintf(file, "opcode,%02X,%llu,%llu\n", opcode,
+                    (unsigned long long)opcode_count[opcode],
+                    (unsigned long long)opcode_cycles[opcode]);
+    for (int pc = 0; pc < 0x10000; pc++)
+        if (pc_count[pc])
+            fprintf(file, "pc,%04X,%llu,%llu\n", pc,
+                    (unsigned long long)pc_count[pc],
+                    (unsigned long long)pc_cycles[pc]);
+    return fclose(file) == 0;
+}
+
+bool Profiler::write_listing(const char* path, Memory& mem)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    U64 total = total_cycles();
+    fprintf(file, "; %llu cycles profiled\n", (unsigned long long)total);
+    fprintf(file, "; addr  bytes     instruction          count       cycles"
+                  "       %%\n");
+    int next = -1;
+    for (int pc = 0; pc < 0x10000; pc++)
+    {
+        if (!pc_count[pc])
+            continue;
+        // A gap in what ran starts a new run of lines
+        if (next != -1 && pc != next)
+            fprintf(file, "\n");
+        U8 code[3] = {mem.peek(pc), mem.peek(pc + 1), mem.peek(pc + 2)};
+        char bytes[12] = "", text[24];
+        int length = disassemble(pc, code, text, sizeof text);
+        for (int i = 0; i < length; i++)
+            snprintf(bytes + i * 3, 4, "%02X ", code[i]);
+        fprintf(file, "  %04X  %-9s %-16s %12llu %12llu %6.2f\n", pc, bytes,
+                text, (unsigned long long)pc_count[pc],
+                (unsigned long long)pc_cycles[pc],
+                total ? pc_cycles[pc] * 100.0 / total : 0.0);
+        next = pc + length;
+    }
+    return fclose(file) == 0;
+}
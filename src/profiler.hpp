@@ -0,0 +1,37 @@
+#pragma once
+#include "memory.hpp"
+#include <cstdint>
+
+#define U64 uint64_t
+
+// Executions and cycles per opcode and per PC, filled in by the interpreter
+// while CPU::enable_profiler() is on. An instruction costs four adds.
+class Profiler
+{
+public:
+    U64 opcode_count[256];
+    U64 opcode_cycles[256];
+    U64 pc_count[0x10000];
+    U64 pc_cycles[0x10000];
+
+    Profiler() { clear(); }
+
+    void count(U16 pc, U8 opcode, U8 cycles)
+    {
+        pc_count[pc]++;
+        pc_cycles[pc] += cycles;
+        opcode_count[opcode]++;
+        opcode_cycles[opcode] += cycles;
+    }
+
+    void clear();
+    U64 total_cycles();
+
+    // kind,key,count,cycles rows: "opcode,A9,..." then "pc,0600,..." for
+    // everything that ran
+    bool write_csv(const char* path);
+    // Disassembly of every PC that ran with its counts and share of cycles.
+    // Instructions are decoded from memory as it is now, so code that has
+    // since been overwritten shows its new bytes.
+    bool write_listing(const char* path, Memory& mem);
+};
@@ -0,0 +1,88 @@
+#include "rom.hpp"
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ROM_MMAP
+#else
+#include <cstdio>
+#include <vector>
+#endif
+
+SharedRom::~SharedRom() { release(); }
+
+void SharedRom::release()
+{
+#ifdef ROM_MMAP
+    if (mapped)
+        munmap((void*)bytes, size);
+    else
+#endif
+        delete[] bytes;
+    bytes = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+// A copy padded with zeros to a whole page
+LoadError SharedRom::load_data(const U8* data, size_t size)
+{
+    if (size > 0x10000)
+        return LOAD_TOO_BIG;
+    release();
+    U8* copy = new U8[(size + 0xFF) & ~(size_t)0xFF]();
+    if (size)
+        memcpy(copy, data, size);
+    bytes = copy;
+    this->size = size;
+    return LOAD_OK;
+}
+
+// Mapped privately and read-only. The system pads the last page with
+// zeros, and every machine mapping the ROM shares the same page cache.
+LoadError SharedRom::load_file(const char* path)
+{
+#ifdef ROM_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LOAD_OPEN_FAILED;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return LOAD_READ_FAILED;
+    }
+    if (st.st_size > 0x10000)
+    {
+        close(fd);
+        return LOAD_TOO_BIG;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return load_data(nullptr, 0);
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return LOAD_READ_FAILED;
+    release();
+    bytes = (const U8*)data;
+    size = st.st_size;
+    mapped = true;
+    return LOAD_OK;
+#else
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return LOAD_OPEN_FAILED;
+    std::vector<U8> data(0x10001);
+    size_t n = fread(data.data(), 1, data.size(), file);
+    bool failed = ferror(file);
+    fclose(file);
+    if (failed)
+        return LOAD_READ_FAILED;
+    return load_data(data.data(), n);
+#endif
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "loader.hpp"
+#include <cstddef>
+
+// Read-only bytes, e.g. firmware, that many Memory objects map with
+// Memory::map_rom() instead of each holding a copy. Files are mapped
+// straight from the page cache. Must outlive every Memory mapping it.
+class SharedRom
+{
+public:
+    const U8* bytes = nullptr;
+    U32 size = 0; // up to 64K
+
+    ~SharedRom();
+    LoadError load_file(const char* path);
+    LoadError load_data(const U8* data, size_t size);
+    int pages() const { return (size + 0xFF) >> 8; }
+
+private:
+    bool mapped = false;
+    void release();
+};
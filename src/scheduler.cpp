@@ -0,0 +1,44 @@
+#include "scheduler.hpp"
+#include <algorithm>
+
+// Heap order: the root is the earliest deadline, ties by id
+static bool later(const Event& a, const Event& b)
+{
+    return a.when > b.when || (a.when == b.when && a.id > b.id);
+}
+
+U32 Scheduler::schedule(U64 when, EventCallback callback, void* context)
+{
+    Event event;
+    event.when = when;
+    event.id = next_id++;
+    event.callback = callback;
+    event.context = context;
+    heap.push_back(event);
+    std::push_heap(heap.begin(), heap.end(), later);
+    return event.id;
+}
+
+bool Scheduler::cancel(U32 id)
+{
+    for (size_t i = 0; i < heap.size(); i++)
+    {
+        if (heap[i].id != id)
+            continue;
+        heap[i] = heap.back();
+        heap.pop_back();
+        std::make_heap(heap.begin(), heap.end(), later);
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::pop_due(U64 now, Event& event)
+{
+    if (heap.empty() || heap.front().when > now)
+        return false;
+    std::pop_heap(heap.begin(), heap.end(), later);
+    event = heap.back();
+    heap.pop_back();
+    return true;
+}
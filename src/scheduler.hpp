@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#define U32 uint32_t
+#define U64 uint64_t
+
+class CPU;
+
+typedef void (*EventCallback)(void* context, CPU& cpu);
+
+struct Event
+{
+    U64 when; // cycle count the event is due at
+    U32 id;
+    EventCallback callback;
+    void* context;
+};
+
+// Pending events as a min-heap on the deadline; events due on the same cycle
+// come out in the order they were scheduled.
+class Scheduler
+{
+public:
+    static const U64 NEVER = ~(U64)0;
+
+    U32 schedule(U64 when, EventCallback callback, void* context);
+    bool cancel(U32 id);
+    U64 next_deadline() { return heap.empty() ? NEVER : heap.front().when; }
+    bool pop_due(U64 now, Event& event);
+    void clear() { heap.clear(); }
+
+private:
+    std::vector<Event> heap;
+    U32 next_id = 1;
+};
@@ -0,0 +1,217 @@
+#include "system.hpp"
+#include <algorithm>
+#include <cstring>
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+System::System(int cpus, U32 memory_size)
+{
+    count = cpus;
+    nodes = new Node[count];
+    staging.resize(0x10000);
+    for (int i = 0; i < count; i++)
+    {
+        Node& node = nodes[i];
+        node.mem = new Memory(memory_size, memory_size == 0x10000
+                                               ? &MemoryArena::shared()
+                                               : nullptr);
+        node.cpu = new CPU(node.mem);
+        node.mem->on_sync_write = log_write;
+        node.mem->sync_context = &node;
+    }
+}
+
+System::~System()
+{
+    stop_workers();
+    for (int i = 0; i < count; i++)
+    {
+        delete nodes[i].cpu;
+        delete nodes[i].mem;
+    }
+    delete[] nodes;
+}
+
+void System::log_write(void* context, U16 address, U8 value)
+{
+    Node& node = *(Node*)context;
+    node.log.push_back({node.cpu->cycles(), address, value});
+}
+
+void System::share_pages(U8 first_page, int pages)
+{
+    Memory& first = *nodes[0].mem;
+    for (int p = 0; p < pages; p++)
+    {
+        U8 page = first_page + p;
+        if ((U32)page << 8 >= first.backing_size)
+            continue;
+        for (int i = 0; i < count; i++)
+        {
+            Memory& mem = *nodes[i].mem;
+            if (i)
+                mem.load(page << 8, first.memory + (page << 8), 256);
+            mem.set_page_flag(page, PAGE_SYNC, true);
+        }
+    }
+}
+
+void System::set_threaded(bool threaded)
+{
+    if (!threaded)
+    {
+        stop_workers();
+        return;
+    }
+    if (!workers.empty())
+        return;
+    stopping = false;
+    for (int i = 1; i < count; i++)
+        workers.emplace_back(&System::worker, this, i, run_epoch);
+}
+
+void System::stop_workers()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+void System::run(U64 num_cycles)
+{
+    U64 start = now, end = now + num_cycles;
+    U64 step = std::max(quantum, 1);
+    if (workers.empty())
+    {
+        for (U64 t = start; t < end;)
+        {
+            t = std::min(t + step, end);
+            for (int i = 0; i < count; i++)
+                run_to(i, t);
+            exchange();
+        }
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            run_start = start;
+            run_end = end;
+            run_quantum = step;
+            run_epoch++;
+        }
+        wake.notify_all();
+        run_cpu(0, start, end, step);
+    }
+    now = end;
+}
+
+void System::run_to(int i, U64 end)
+{
+    CPU& cpu = *nodes[i].cpu;
+    if (cpu.cycles() < end)
+        cpu.execute(end - cpu.cycles());
+}
+
+// One CPU's share of a threaded run. The final arrive() is past the final
+// exchange, so when CPU 0 returns from here the run is complete.
+void System::run_cpu(int i, U64 start, U64 end, U64 step)
+{
+    for (U64 t = start; t < end;)
+    {
+        t = std::min(t + step, end);
+        run_to(i, t);
+        arrive();
+    }
+}
+
+// Sense-reversing barrier: waiters spin on generation, which only the last
+// to arrive moves on, and that only after the exchange
+void System::arrive()
+{
+    U32 seen = generation.load(std::memory_order_acquire);
+    if (arrived.fetch_add(1, std::memory_order_acq_rel) == count - 1)
+    {
+        exchange();
+        arrived.store(0, std::memory_order_relaxed);
+        generation.store(seen + 1, std::memory_order_release);
+        return;
+    }
+    for (int spins = 0; generation.load(std::memory_order_acquire) == seen;
+         spins++)
+        if (spins < 256)
+            cpu_relax();
+        else
+            std::this_thread::yield();
+}
+
+void System::exchange()
+{
+    merged.clear();
+    int writers = 0;
+    for (int i = 0; i < count; i++)
+    {
+        std::vector<SharedWrite>& log = nodes[i].log;
+        if (log.empty())
+            continue;
+        merged.insert(merged.end(), log.begin(), log.end());
+        log.clear();
+        writers++;
+    }
+    // Each log is in cycle order and they went in by CPU, so a stable sort
+    // settles ties by CPU
+    if (writers > 1)
+        std::stable_sort(merged.begin(), merged.end(),
+                         [](const SharedWrite& a, const SharedWrite& b)
+                         { return a.cycle < b.cycle; });
+    // Copies agree outside this quantum's writes, so every touched page ends
+    // up the same everywhere: built once, then loaded into each memory
+    U64 touched[4] = {};
+    for (const SharedWrite& write : merged)
+    {
+        U8 page = write.address >> 8;
+        U64 bit = (U64)1 << (page & 63);
+        if (!(touched[page >> 6] & bit))
+        {
+            touched[page >> 6] |= bit;
+            memcpy(&staging[page << 8], nodes[0].mem->memory + (page << 8),
+                   256);
+        }
+        staging[write.address] = write.value;
+    }
+    for (int page = 0; page < 256 && !merged.empty(); page++)
+        if ((touched[page >> 6] >> (page & 63)) & 1)
+            for (int i = 0; i < count; i++)
+                nodes[i].mem->load(page << 8, &staging[page << 8], 256);
+    if (on_exchange)
+        on_exchange(exchange_context, *this);
+}
+
+void System::worker(int i, U64 seen)
+{
+    for (;;)
+    {
+        U64 start, end, step;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || run_epoch != seen; });
+            if (stopping)
+                return;
+            seen = run_epoch;
+            start = run_start;
+            end = run_end;
+            step = run_quantum;
+        }
+        run_cpu(i, start, end, step);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "cpu.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Several CPUs run as one machine, e.g. a main CPU and a drive CPU talking
+// through shared RAM. Every CPU has its own Memory and shared pages are kept
+// as a copy in each. A write to a shared page lands in the writer's copy and
+// is logged; at the end of every quantum the logs are merged by cycle, ties
+// going to the lower CPU, and played into every copy. So a CPU sees its own
+// writes at once and the others' at the next quantum, and the outcome is the
+// same whether the CPUs run on the caller's thread or on one thread each.
+// Only CPU writes are passed on: loads into one memory's shared pages are
+// not. Devices are per Memory; anything linking two CPUs belongs in
+// on_exchange.
+class System
+{
+public:
+    int quantum = 1000; // cycles between exchanges, the others' latency
+    // Called on one thread at every exchange, after the logs are played,
+    // while no CPU is running
+    void (*on_exchange)(void* context, System& system) = nullptr;
+    void* exchange_context = nullptr;
+
+    System(int cpus, U32 memory_size = 0x10000);
+    ~System();
+
+    int size() { return count; }
+    CPU& cpu(int i) { return *nodes[i].cpu; }
+    Memory& memory(int i) { return *nodes[i].mem; }
+    U64 cycles() { return now; }
+
+    // Shares the pages from first_page on between all CPUs, with the
+    // contents of CPU 0's memory. Pages past the memory size are skipped.
+    void share_pages(U8 first_page, int pages);
+    // One thread per CPU from the next run() on, CPU 0 on the caller's.
+    // Quanta end at a spinning barrier, so this pays when every CPU has a
+    // core of its own.
+    void set_threaded(bool threaded);
+    // Runs every CPU to cycles() + num_cycles, a quantum at a time; an
+    // exchange also ends the run. Each CPU stops at the first instruction
+    // boundary past a quantum end, as with CPU::execute().
+    void run(U64 num_cycles);
+
+private:
+    struct SharedWrite
+    {
+        U64 cycle;
+        U16 address;
+        U8 value;
+    };
+
+    struct alignas(64) Node
+    {
+        CPU* cpu;
+        Memory* mem;
+        std::vector<SharedWrite> log; // this quantum's shared writes
+    };
+
+    int count;
+    Node* nodes;
+    U64 now = 0;
+    std::vector<SharedWrite> merged;
+    std::vector<U8> staging; // pages being exchanged, at their addresses
+
+    // Barrier: the last CPU to arrive does the exchange and bumps generation
+    alignas(64) std::atomic<int> arrived{0};
+    alignas(64) std::atomic<U32> generation{0};
+
+    // Workers wait here between runs
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    U64 run_epoch = 0;
+    U64 run_start = 0;
+    U64 run_end = 0;
+    U64 run_quantum = 0;
+    bool stopping = false;
+
+    static void log_write(void* context, U16 address, U8 value);
+    void run_to(int i, U64 end);
+    void run_cpu(int i, U64 start, U64 end, U64 step);
+    void arrive();
+    void exchange();
+    void worker(int i, U64 seen);
+    void stop_workers();
+};
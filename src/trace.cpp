@@ -0,0 +1,145 @@
+#include "trace.hpp"
+#include <chrono>
+#include <cstring>
+
+static const char TRACE_MAGIC[8] = {'6', '5', '0', '2', 'T', 'R', 'C', '1'};
+
+TraceWriter::TraceWriter() { ring = new TraceRecord[RING_SIZE]; }
+
+TraceWriter::~TraceWriter()
+{
+    close();
+    delete[] ring;
+}
+
+bool TraceWriter::open(const char* path)
+{
+    close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    fwrite(TRACE_MAGIC, 1, sizeof TRACE_MAGIC, file);
+    memset(&last, 0, sizeof last);
+    head = cached_tail = 0;
+    published.store(0);
+    tail.store(0);
+    drop_count = write_count = 0;
+    stopping.store(false);
+    writer = std::thread(&TraceWriter::drain, this);
+    return true;
+}
+
+void TraceWriter::close()
+{
+    if (!file)
+        return;
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    out.push_back(0);
+    out.push_back(0);
+    for (U64 count : {write_count, drop_count})
+        for (int i = 0; i < 8; i++)
+            out.push_back(count >> (i * 8));
+    fwrite(out.data(), 1, out.size(), file);
+    out.clear();
+    fclose(file);
+    file = nullptr;
+}
+
+void TraceWriter::encode(const TraceRecord& record)
+{
+    const U8* now = (const U8*)&record;
+    const U8* before = (const U8*)&last;
+    size_t size = out.size();
+    out.resize(size + 18);
+    U8* p = out.data() + size + 2;
+    U16 mask = 0;
+    for (int i = 0; i < 16; i++)
+        if (now[i] != before[i])
+        {
+            mask |= 1 << i;
+            *p++ = now[i];
+        }
+    out[size] = mask;
+    out[size + 1] = mask >> 8;
+    out.resize(p - out.data());
+    last = record;
+    write_count++;
+}
+
+// Writer thread: takes whatever the ring holds, polling while it is empty,
+// until close() asks it to stop and everything pushed so far is out
+void TraceWriter::drain()
+{
+    for (;;)
+    {
+        bool stop = stopping.load(std::memory_order_acquire);
+        U32 end = published.load(std::memory_order_acquire);
+        U32 start = tail.load(std::memory_order_relaxed);
+        if (start == end)
+        {
+            if (stop)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        for (U32 i = start; i != end; i++)
+            encode(ring[i & (RING_SIZE - 1)]);
+        tail.store(end, std::memory_order_release);
+        if (out.size() >= 1 << 16)
+        {
+            fwrite(out.data(), 1, out.size(), file);
+            out.clear();
+        }
+    }
+}
+
+TraceReader::~TraceReader()
+{
+    if (file)
+        fclose(file);
+}
+
+bool TraceReader::open(const char* path)
+{
+    file = fopen(path, "rb");
+    if (!file)
+        return false;
+    char magic[sizeof TRACE_MAGIC];
+    memset(&last, 0, sizeof last);
+    return fread(magic, 1, sizeof magic, file) == sizeof magic &&
+           !memcmp(magic, TRACE_MAGIC, sizeof magic);
+}
+
+// False at the end marker or a truncated file
+bool TraceReader::next(TraceRecord& record)
+{
+    U8 buffer[16];
+    if (complete || fread(buffer, 1, 2, file) != 2)
+        return false;
+    U16 mask = buffer[0] | buffer[1] << 8;
+    if (!mask)
+    {
+        if (fread(buffer, 1, 16, file) != 16)
+            return false;
+        written = dropped = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            written = written << 8 | buffer[i];
+            dropped = dropped << 8 | buffer[8 + i];
+        }
+        complete = true;
+        return false;
+    }
+    U8* bytes = (U8*)&last;
+    for (int i = 0; i < 16; i++)
+        if (mask >> i & 1)
+        {
+            int c = fgetc(file);
+            if (c == EOF)
+                return false;
+            bytes[i] = c;
+        }
+    record = last;
+    return true;
+}
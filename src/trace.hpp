@@ -0,0 +1,99 @@
+#pragma once
+#include "memory.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#define U32 uint32_t
+#define U64 uint64_t
+
+// One executed instruction and the state it started from
+struct TraceRecord
+{
+    U32 cycle_lo; // cycle the instruction started on, 48 bits
+    U16 cycle_hi;
+    U16 pc;
+    U8 opcode;
+    U8 operand[2]; // zero past the instruction's length
+    U8 a;
+    U8 x;
+    U8 y;
+    U8 sp;
+    U8 p;
+
+    U64 cycle() const { return cycle_lo | (U64)cycle_hi << 32; }
+};
+
+static_assert(sizeof(TraceRecord) == 16, "trace records are 16 bytes");
+
+// Trace file: "6502TRC1", then per record a little-endian 16 bit mask of the
+// bytes that differ from the previous record followed by those bytes. The
+// cycle advances every instruction, so a zero mask can only be the end
+// marker, which carries the written and dropped record counts (U64 each).
+
+// Streams records to a trace file. The emulation thread pushes into a
+// single-producer ring that a writer thread drains, compresses and writes.
+// A full ring drops the record (see dropped()) instead of waiting.
+class TraceWriter
+{
+public:
+    static const U32 RING_SIZE = 1 << 20; // records, a power of two
+
+    TraceWriter();
+    ~TraceWriter();
+    bool open(const char* path);
+    void close(); // drains the ring and writes the end marker
+    U64 dropped() { return drop_count; }
+
+    void push(const TraceRecord& record)
+    {
+        if (head - cached_tail == RING_SIZE)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (head - cached_tail == RING_SIZE)
+            {
+                drop_count++;
+                return;
+            }
+        }
+        ring[head & (RING_SIZE - 1)] = record;
+        head++;
+        published.store(head, std::memory_order_release);
+    }
+
+private:
+    TraceRecord* ring;
+    U32 head = 0;        // producer's next slot
+    U32 cached_tail = 0; // producer's last look at tail
+    std::atomic<U32> published{0};
+    std::atomic<U32> tail{0};
+    std::atomic<bool> stopping{false};
+    U64 drop_count = 0;
+    U64 write_count = 0;
+    FILE* file = nullptr;
+    std::thread writer;
+    std::vector<U8> out;
+    TraceRecord last;
+
+    void drain();
+    void encode(const TraceRecord& record);
+};
+
+// Decodes a trace file record by record
+class TraceReader
+{
+public:
+    U64 written = 0; // counts from the end marker, once next() hits it
+    U64 dropped = 0;
+    bool complete = false; // the end marker was seen
+
+    ~TraceReader();
+    bool open(const char* path);
+    bool next(TraceRecord& record);
+
+private:
+    FILE* file = nullptr;
+    TraceRecord last;
+};
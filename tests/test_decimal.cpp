@@ -0,0 +1,150 @@
+// Runs every decimal mode ADC and SBC, for all accumulator, operand and
+// carry values, and checks A, C, N, V and Z against NMOS results worked out
+// here, apart from alu.hpp, following Bruce Clark's "Decimal Mode" tutorial
+// (6502.org, appendix A). Exits non-zero on a mismatch.
+#include "cpu.hpp"
+#include <cstdio>
+
+struct Expected
+{
+    U8 a;
+    bool c, n, v, z;
+};
+
+// Sequence 1: the accumulator and carry of ADC
+static int adc_sequence_1(int a, int b, int c)
+{
+    int al = (a & 0x0F) + (b & 0x0F) + c;
+    if (al >= 0x0A)
+        al = ((al + 0x06) & 0x0F) + 0x10;
+    int sum = (a & 0xF0) + (b & 0xF0) + al;
+    if (sum >= 0xA0)
+        sum += 0x60;
+    return sum; // may be 0x100 or more: that is the carry
+}
+
+// Sequence 2: the same sum in signed arithmetic, without the high digit
+// adjusted, gives N and V of ADC
+static int adc_sequence_2(int a, int b, int c)
+{
+    int al = (a & 0x0F) + (b & 0x0F) + c;
+    if (al >= 0x0A)
+        al = ((al + 0x06) & 0x0F) + 0x10;
+    return (int8_t)(a & 0xF0) + (int8_t)(b & 0xF0) + al;
+}
+
+// Sequence 3: the accumulator of SBC on NMOS parts
+static int sbc_sequence_3(int a, int b, int c)
+{
+    int al = (a & 0x0F) - (b & 0x0F) + c - 1;
+    if (al < 0)
+        al = ((al - 0x06) & 0x0F) - 0x10;
+    int diff = (a & 0xF0) - (b & 0xF0) + al;
+    if (diff < 0)
+        diff -= 0x60;
+    return diff & 0xFF;
+}
+
+static Expected adc(int a, int b, int c)
+{
+    int sum = adc_sequence_1(a, b, c);
+    int signed_sum = adc_sequence_2(a, b, c);
+    Expected e;
+    e.a = sum & 0xFF;
+    e.c = sum >= 0x100;
+    e.n = signed_sum & 0x80;
+    e.v = signed_sum < -128 || signed_sum > 127;
+    e.z = ((a + b + c) & 0xFF) == 0; // Z is the binary sum's
+    return e;
+}
+
+// Only A differs from a binary SBC
+static Expected sbc(int a, int b, int c)
+{
+    int diff = a - b - (1 - c);
+    int signed_diff = (int8_t)a - (int8_t)b - (1 - c);
+    Expected e;
+    e.a = sbc_sequence_3(a, b, c);
+    e.c = diff >= 0;
+    e.n = diff & 0x80;
+    e.v = signed_diff < -128 || signed_diff > 127;
+    e.z = (diff & 0xFF) == 0;
+    return e;
+}
+
+// A few results worked by hand, to catch the sequences above and the ALU
+// going wrong together
+struct Known
+{
+    bool subtract;
+    U8 a, b, c;
+    U8 result;
+    bool carry;
+};
+
+static const Known known[] = {
+    {false, 0x12, 0x34, 0, 0x46, false},
+    {false, 0x58, 0x46, 1, 0x05, true},
+    {false, 0x99, 0x01, 0, 0x00, true},
+    {false, 0x81, 0x92, 0, 0x73, true},
+    {false, 0x0F, 0x00, 0, 0x15, false}, // invalid digit
+    {true, 0x46, 0x12, 1, 0x34, true},
+    {true, 0x40, 0x13, 1, 0x27, true},
+    {true, 0x32, 0x02, 0, 0x29, true},
+    {true, 0x12, 0x21, 1, 0x91, false},
+    {true, 0x00, 0x01, 1, 0x99, false},
+};
+
+static int failures = 0;
+
+static void check(CPU& cpu, bool subtract, U8 a, U8 b, U8 c,
+                  const Expected& want)
+{
+    // SED, CLC or SEC, LDA #a, ADC or SBC #b
+    U8 code[] = {0xF8, (U8)(c ? 0x38 : 0x18), 0xA9, a,
+                 (U8)(subtract ? 0xE9 : 0x69), b};
+    cpu.memory()->load(0x0600, code, sizeof(code));
+    cpu.set_registers({0x0600, 0, 0, 0, 0xFF, 0});
+    cpu.execute(2 + 2 + 2 + 2);
+    Registers r = cpu.get_registers();
+    bool same = r.PC == 0x0606 && r.A == want.a &&
+                (bool)(r.P & 1 << CARRY_FLAG) == want.c &&
+                (bool)(r.P & 1 << NEGATIVE_FLAG) == want.n &&
+                (bool)(r.P & 1 << OVERFLOW_FLAG) == want.v &&
+                (bool)(r.P & 1 << ZERO_FLAG) == want.z;
+    if (!same && failures++ < 8)
+        printf("%s %.2X %.2X carry %d: A %.2X P %.2X, want A %.2X C%d N%d "
+               "V%d Z%d\n",
+               subtract ? "SBC" : "ADC", a, b, c, r.A, r.P, want.a, want.c,
+               want.n, want.v, want.z);
+}
+
+int main()
+{
+    Memory mem;
+    CPU cpu(&mem);
+    cpu.report_illegal = false;
+
+    for (const Known& k : known)
+    {
+        Expected e = k.subtract ? sbc(k.a, k.b, k.c) : adc(k.a, k.b, k.c);
+        if (e.a != k.result || e.c != k.carry)
+        {
+            failures++;
+            printf("%s %.2X %.2X carry %d: worked %.2X C%d, by hand %.2X "
+                   "C%d\n",
+                   k.subtract ? "SBC" : "ADC", k.a, k.b, k.c, e.a, e.c,
+                   k.result, k.carry);
+        }
+    }
+
+    for (int subtract = 0; subtract < 2; subtract++)
+        for (int c = 0; c < 2; c++)
+            for (int a = 0; a < 256; a++)
+                for (int b = 0; b < 256; b++)
+                    check(cpu, subtract, a, b, c,
+                          subtract ? sbc(a, b, c) : adc(a, b, c));
+
+    printf("test_decimal: %d mismatches\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,243 @@
+// Runs the same programs under the interpreter, the block cache and the JIT
+// and checks that registers and cycle counts agree after every slice, and
+// memory at intervals. Exits non-zero on a mismatch.
+#include "batch.hpp"
+#include "cpu.hpp"
+#include "devices.hpp"
+#include <cstdio>
+#include <random>
+
+enum Engine
+{
+    ENGINE_INTERP,
+    ENGINE_BLOCKS,
+    ENGINE_JIT,
+    ENGINES
+};
+
+static const char* engine_names[] = {"interp", "blocks", "jit"};
+
+struct State
+{
+    Registers r;
+    U64 cycles;
+    U64 digest;
+
+    bool operator==(const State& o) const
+    {
+        return r.PC == o.r.PC && r.A == o.r.A && r.X == o.r.X &&
+               r.Y == o.r.Y && r.SP == o.r.SP && r.P == o.r.P &&
+               cycles == o.cycles && digest == o.digest;
+    }
+};
+
+// Memory is only hashed when asked, it dominates the run time otherwise
+static State state(CPU& cpu, bool digest)
+{
+    return {cpu.get_registers(), cpu.cycles(),
+            digest ? memory_digest(*cpu.memory()) : 0};
+}
+
+static void set_engine(CPU& cpu, int engine)
+{
+    cpu.report_illegal = false;
+    cpu.enable_block_cache(engine != ENGINE_INTERP);
+    cpu.enable_jit(engine == ENGINE_JIT);
+}
+
+static int failures = 0;
+
+// Reports the first slice each engine disagrees with the interpreter on
+template <int SLICES>
+static void compare(const char* test, int trial,
+                    const State (&states)[ENGINES][SLICES])
+{
+    for (int engine = ENGINE_BLOCKS; engine < ENGINES; engine++)
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            const State& got = states[engine][slice];
+            const State& want = states[ENGINE_INTERP][slice];
+            if (got == want)
+                continue;
+            if (failures++ < 8)
+                printf("%s %d: %s differs at slice %d: PC %.4X/%.4X "
+                       "A %.2X/%.2X P %.2X/%.2X cycles %llu/%llu memory %s\n",
+                       test, trial, engine_names[engine], slice, got.r.PC,
+                       want.r.PC, got.r.A, want.r.A, got.r.P, want.r.P,
+                       (unsigned long long)got.cycles,
+                       (unsigned long long)want.cycles,
+                       got.digest == want.digest ? "same" : "differs");
+            break;
+        }
+}
+
+// Random legal opcodes at 0x0600 with some short backward branches so
+// blocks get hot, and the IRQ, BRK and NMI vectors pointing back into it.
+// Random stores land in the code often enough to exercise invalidation.
+static void random_programs(int trials)
+{
+    std::mt19937 rng(0x6502);
+    static const int SLICES = 60;
+    for (int trial = 0; trial < trials; trial++)
+    {
+        U8 code[512];
+        for (U8& b : code)
+        {
+            do
+                b = rng();
+            while (opcode_info[b].mnemonic == Mnemonic::ILLEGAL);
+        }
+        for (int i = 0; i < 20; i++)
+        {
+            int at = rng() % (sizeof(code) - 2);
+            code[at] = 0xD0; // BNE
+            code[at + 1] = -(int)(rng() % 40) - 2;
+        }
+        U8 zero_page[256];
+        for (U8& b : zero_page)
+            b = rng();
+        Registers start = {0x0600, (U8)rng(), (U8)rng(), (U8)rng(), 0xFF,
+                           (U8)(rng() & ~(1 << DECIMAL_MODE))};
+        static const U8 vectors[6] = {0x00, 0x06, 0x00, 0x06, 0x40, 0x06};
+
+        State states[ENGINES][SLICES];
+        for (int engine = 0; engine < ENGINES; engine++)
+        {
+            Memory mem;
+            CPU cpu(&mem);
+            set_engine(cpu, engine);
+            mem.load(0x0000, zero_page, sizeof(zero_page));
+            mem.load(0x0600, code, sizeof(code));
+            mem.load(0xFFFA, vectors, sizeof(vectors));
+            cpu.set_registers(start);
+            for (int slice = 0; slice < SLICES; slice++)
+            {
+                if (slice == 30)
+                    cpu.set_irq(true);
+                if (slice == 33)
+                    cpu.set_irq(false);
+                if (slice == 40)
+                    cpu.trigger_nmi();
+                cpu.execute(50 + slice * 37 % 400);
+                states[engine][slice] = state(cpu, slice == SLICES - 1);
+            }
+        }
+        compare("random", trial, states);
+    }
+}
+
+// A loop that patches the immediate operand of an instruction further on,
+// interrupted by a timer IRQ whose handler acknowledges it through the
+// device page.
+static void self_modifying()
+{
+    static const U8 code[] = {
+        0xA9, 0x00, 0x8D, 0xFE, 0xFF, // LDA #<irq, STA $FFFE
+        0xA9, 0x07, 0x8D, 0xFF, 0xFF, // LDA #>irq, STA $FFFF
+        0xA9, 77,   0x8D, 0x00, 0xD0, // timer period 77
+        0xA9, 0x00, 0x8D, 0x01, 0xD0,
+        0xA9, 0x03, 0x8D, 0x02, 0xD0, // running, IRQ on expiry
+        0x58,                         // CLI
+        0xE6, 0x20,                   // loop: INC $20
+        0xA5, 0x20,                   // LDA $20
+        0x8D, 0x22, 0x06,             // STA $0622, the LDX operand
+        0xA2, 0x00,                   // LDX #0
+        0x86, 0x21,                   // STX $21
+        0xAC, 0x03, 0xD0,             // LDY $D003
+        0xFE, 0x00, 0x40,             // INC $4000,X
+        0x4C, 0x1A, 0x06,             // JMP loop
+    };
+    static const U8 irq[] = {
+        0x48,             // PHA
+        0xE6, 0x22,       // INC $22
+        0x8D, 0x03, 0xD0, // STA $D003, acknowledge
+        0x68,             // PLA
+        0x40,             // RTI
+    };
+    static const int SLICES = 2000;
+    static State states[ENGINES][SLICES];
+    for (int engine = 0; engine < ENGINES; engine++)
+    {
+        Memory mem;
+        CPU cpu(&mem);
+        set_engine(cpu, engine);
+        IntervalTimer timer;
+        timer.attach(cpu, 0xD0);
+        mem.load(0x0600, code, sizeof(code));
+        mem.load(0x0700, irq, sizeof(irq));
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            cpu.execute(97 + slice % 13);
+            states[engine][slice] = state(cpu, slice % 100 == 99);
+        }
+    }
+    compare("self-modifying", 0, states);
+}
+
+// Every 8th read of its register raises an NMI, which has to be taken
+// right after the reading instruction
+class NmiOnRead : public Device
+{
+public:
+    CPU* cpu;
+    int reads = 0;
+
+    U8 read(U16 address) override
+    {
+        if (++reads % 8 == 0)
+            cpu->trigger_nmi();
+        return reads;
+    }
+    void write(U16 address, U8 value) override {}
+};
+
+// A hot loop reading the device, so the JIT compiles it and the NMI comes
+// from the slow path of a native load; the handler records X, which tells
+// how far the loop got
+static void nmi_from_load()
+{
+    static const U8 code[] = {
+        0xAD, 0x00, 0xD0, // loop: LDA $D000
+        0xE8,             // INX
+        0xC8,             // INY
+        0xE6, 0x10,       // INC $10
+        0xE8,             // INX
+        0xC8,             // INY
+        0x4C, 0x00, 0x06, // JMP loop
+    };
+    static const U8 nmi[] = {
+        0xE6, 0x11, // INC $11
+        0x86, 0x12, // STX $12
+        0x40,       // RTI
+    };
+    static const U8 vector[2] = {0x00, 0x07};
+    static const int SLICES = 500;
+    static State states[ENGINES][SLICES];
+    for (int engine = 0; engine < ENGINES; engine++)
+    {
+        Memory mem;
+        CPU cpu(&mem);
+        set_engine(cpu, engine);
+        NmiOnRead device;
+        device.cpu = &cpu;
+        mem.map_device(0xD0, 1, &device);
+        mem.load(0x0600, code, sizeof(code));
+        mem.load(0x0700, nmi, sizeof(nmi));
+        mem.load(0xFFFA, vector, sizeof(vector));
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            cpu.execute(1000);
+            states[engine][slice] = state(cpu, true);
+        }
+    }
+    compare("nmi-from-load", 0, states);
+}
+
+int main()
+{
+    random_programs(2000);
+    self_modifying();
+    nmi_from_load();
+    printf("test_engines: %d mismatches\n", failures);
+    return failures != 0;
+}
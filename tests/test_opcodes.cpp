@@ -0,0 +1,14 @@
+// Checks the fused opcode handlers against the reference table handlers,
+// see CPU::verify_opcodes(). Exits non-zero on a mismatch.
+#include "cpu.hpp"
+#include <cstdio>
+
+int main()
+{
+    Memory mem;
+    CPU cpu(&mem);
+    cpu.report_illegal = false;
+    int failed = cpu.verify_opcodes();
+    printf("test_opcodes: %d opcodes disagree\n", failed);
+    return failed != 0;
+}
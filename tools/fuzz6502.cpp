@@ -0,0 +1,131 @@
+// Fuzz target for 6502 code, set up from the environment (hex numbers):
+//   FUZZ6502_IMAGE   program image, any format the loader takes (required)
+//   FUZZ6502_LOAD    load address of raw images, default 0600
+//   FUZZ6502_ENTRY   start address, default a HEX file's own or the load
+//                    address
+//   FUZZ6502_INPUT   ADDR[:SIZE] the input is put at, default 0200:100
+//   FUZZ6502_LENGTH  where the input length goes as a word, default nowhere
+//   FUZZ6502_CYCLES  cycles per input, default 186A0 (100000)
+//   FUZZ6502_CRASH   address that counts as a crash when it is reached
+// A run ends on BRK or when the cycles run out. Reaching FUZZ6502_CRASH or
+// an illegal opcode aborts, which the fuzzer reports as a crash.
+// make tools builds bin/fuzz6502, which runs the files given as inputs and
+// prints how each ended. make fuzz builds bin/fuzz6502-libfuzzer with clang's
+// libFuzzer, which sees the 6502 edge coverage through its extra counters.
+#include "fuzz.hpp"
+#include "loader.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifdef LIBFUZZER
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static U8 edges[COVERAGE_SIZE];
+
+static FuzzHarness* harness;
+static int crash_address = -1;
+
+static long env_hex(const char* name, long fallback, char** rest = nullptr)
+{
+    const char* value = getenv(name);
+    if (!value || !*value)
+        return fallback;
+    char* end;
+    long number = strtol(value, &end, 16);
+    if (rest)
+        *rest = end;
+    return number;
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***)
+{
+    const char* image = getenv("FUZZ6502_IMAGE");
+    if (!image)
+    {
+        fprintf(stderr, "fuzz: FUZZ6502_IMAGE is not set\n");
+        exit(1);
+    }
+    harness = new FuzzHarness(edges);
+    U16 load = env_hex("FUZZ6502_LOAD", 0x0600);
+    Loader loader(&harness->memory());
+    LoadError error = loader.load_file(image, IMAGE_AUTO, load);
+    if (error != LOAD_OK)
+    {
+        fprintf(stderr, "fuzz: %s: %s\n", image, Loader::error_string(error));
+        exit(1);
+    }
+
+    CPU& cpu = harness->cpu();
+    Registers r = cpu.get_registers();
+    r.PC = env_hex("FUZZ6502_ENTRY", loader.entry >= 0 ? loader.entry : load);
+    cpu.set_registers(r);
+    char* rest = nullptr;
+    harness->input_address = env_hex("FUZZ6502_INPUT", 0x0200, &rest);
+    if (rest && *rest == ':')
+        harness->input_size = strtol(rest + 1, nullptr, 16);
+    harness->length_address = env_hex("FUZZ6502_LENGTH", -1);
+    harness->max_cycles = env_hex("FUZZ6502_CYCLES", 100000);
+    crash_address = env_hex("FUZZ6502_CRASH", -1);
+    if (crash_address >= 0)
+        cpu.set_breakpoint(crash_address, true);
+    for (int opcode = 0; opcode < 256; opcode++)
+        if (opcode_info[opcode].mnemonic == Mnemonic::ILLEGAL)
+            cpu.stop_on_opcode(opcode, true);
+    harness->arm();
+    return 0;
+}
+
+static void check(const StopInfo& stop)
+{
+    if (stop.reason == STOP_OPCODE ||
+        (stop.reason == STOP_BREAKPOINT && stop.address == crash_address))
+    {
+        fprintf(stderr, "fuzz: %s at %04X\n",
+                stop.reason == STOP_OPCODE ? "illegal opcode" : "crash",
+                stop.address);
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    check(harness->run(data, size));
+    return 0;
+}
+
+#ifndef LIBFUZZER
+static const char* reason_names[] = {"none",      "cycles", "breakpoint",
+                                     "brk",       "opcode", "read watch",
+                                     "write watch"};
+
+// Replays inputs without a fuzzing engine, e.g. to look at a crash
+int main(int argc, char** argv)
+{
+    LLVMFuzzerInitialize(&argc, &argv);
+    for (int i = 1; i < argc; i++)
+    {
+        FILE* file = fopen(argv[i], "rb");
+        if (!file)
+        {
+            fprintf(stderr, "fuzz: cannot open %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<U8> input;
+        int c;
+        while ((c = fgetc(file)) != EOF)
+            input.push_back(c);
+        fclose(file);
+
+        StopInfo stop = harness->run(input.data(), input.size());
+        int hit = 0;
+        for (int e = 0; e < COVERAGE_SIZE; e++)
+            hit += edges[e] != 0;
+        printf("%s: %s at %04X after %d cycles, %d edges\n", argv[i],
+               reason_names[stop.reason], stop.address, stop.cycles, hit);
+        fflush(stdout);
+        check(stop);
+    }
+    return 0;
+}
+#endif
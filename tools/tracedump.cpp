@@ -0,0 +1,101 @@
+// Prints a trace file written by CPU::start_trace() as text, one
+// instruction per line, keeping only the records that pass the filters.
+// Usage: tracedump [--pc FROM[-TO]] [--opcode XX] [--from CYCLE]
+//                  [--to CYCLE] [--limit N] [--summary] FILE
+#include "opcodes.hpp"
+#include "trace.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [--pc FROM[-TO]] [--opcode XX] [--from CYCLE] "
+            "[--to CYCLE] [--limit N] [--summary] FILE\n",
+            name);
+}
+
+int main(int argc, char** argv)
+{
+    U16 pc_from = 0, pc_to = 0xFFFF;
+    int opcode = -1;
+    U64 cycle_from = 0, cycle_to = ~(U64)0, limit = ~(U64)0;
+    bool summary = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--pc" && has_value)
+        {
+            char* end;
+            pc_from = pc_to = strtoul(argv[++i], &end, 16);
+            if (*end == '-')
+                pc_to = strtoul(end + 1, nullptr, 16);
+        }
+        else if (arg == "--opcode" && has_value)
+            opcode = strtoul(argv[++i], nullptr, 16) & 0xFF;
+        else if (arg == "--from" && has_value)
+            cycle_from = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--to" && has_value)
+            cycle_to = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--limit" && has_value)
+            limit = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--summary")
+            summary = true;
+        else if (arg[0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TraceReader reader;
+    if (!reader.open(path))
+    {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        return 1;
+    }
+    TraceRecord r;
+    U64 read = 0, shown = 0;
+    while (reader.next(r))
+    {
+        read++;
+        if (r.pc < pc_from || r.pc > pc_to ||
+            (opcode >= 0 && r.opcode != opcode) || r.cycle() < cycle_from ||
+            r.cycle() > cycle_to)
+            continue;
+        if (shown == limit)
+            break;
+        shown++;
+        if (summary)
+            continue;
+        U8 bytes[3] = {r.opcode, r.operand[0], r.operand[1]};
+        char text[24], hex[12] = "";
+        int length = disassemble(r.pc, bytes, text, sizeof text);
+        for (int i = 0; i < length; i++)
+            snprintf(hex + i * 3, 4, "%02X ", bytes[i]);
+        printf("%12llu  %04X  %-9s %-14s A=%02X X=%02X Y=%02X SP=%02X P=%02X\n",
+               (unsigned long long)r.cycle(), r.pc, hex, text, r.a, r.x, r.y,
+               r.sp, r.p);
+    }
+    if (summary)
+    {
+        printf("records read: %llu\n", (unsigned long long)read);
+        printf("records matched: %llu\n", (unsigned long long)shown);
+        if (reader.complete)
+            printf("records dropped while tracing: %llu\n",
+                   (unsigned long long)reader.dropped);
+        else if (shown < limit)
+            printf("no end marker: the trace was not closed\n");
+    }
+    return 0;
+}